@@ -16,13 +16,14 @@
 #include "pq.h"
 
 typedef struct pq_node {
-  double priority; 
+  pq_prio_t priority; 
   int id;
   int heapindx;
 } NODE;
 
 
 struct pq_struct {
+  NODE *pool;     /* node of id i is pool[i]; no per-insert malloc */
   NODE **arrHeap;
   int **arrID;
   int capacity;
@@ -46,6 +47,7 @@ PQ * pq_create(int capacity, int min_heap) {
     capacity = 50;
   int i;
   PQ *ret = malloc(sizeof(PQ));
+  ret->pool = malloc(sizeof(NODE) * capacity);
   ret->arrHeap = malloc(sizeof(NODE*) * (capacity + 1));
   ret->arrID = malloc(sizeof(int*)*capacity);
   for(i = 0; i < capacity; i++) {
@@ -70,15 +72,18 @@ PQ * pq_create(int capacity, int min_heap) {
  *
  */
 void pq_free(PQ * pq) {
-  int i;
-  for(i = 0; i < pq_capacity(pq); i++)
-    if(pq->arrID[i] != NULL)
-      free(pq->arrHeap[*(pq->arrID[i])]);
+  free(pq->pool);
   free(pq->arrHeap);
   free(pq->arrID);
   free(pq);
 }
 
+/* 1 if priority a belongs above priority b (no multiplication by
+ * dir: pq_prio_t may be unsigned) */
+static inline int above(PQ * pq, pq_prio_t a, pq_prio_t b) {
+  return pq->dir > 0 ? a > b : a < b;
+}
+
 /**
  * Function: perc_up
  * Parameters: priority queue pq
@@ -92,9 +97,8 @@ void pq_free(PQ * pq) {
  */
 static void perc_up(PQ * pq, int i) {
   NODE *target = pq->arrHeap[i];
-  int dir = pq->dir;
   int p = i/2;
-  while(p >= 1 && (pq->arrHeap[p]->priority * dir) < (target->priority * dir)) {
+  while(p >= 1 && above(pq, target->priority, pq->arrHeap[p]->priority)) {
     pq->arrHeap[i] = pq->arrHeap[p];
     pq->arrHeap[p]->heapindx = i;
     i = p;
@@ -118,16 +122,15 @@ static void perc_up(PQ * pq, int i) {
 static void perc_down(PQ * pq, int i) {
   NODE *target = pq->arrHeap[i];
   int l, r, done, n;
-  int dir = pq->dir;
   done = 0;
   n = pq->size;
   l = 2*i;
   r = l+1;
   while(l <= n && !done) {
     int min_i = l;
-    if(r <= n && (pq->arrHeap[r]->priority * dir) > (pq->arrHeap[l]->priority * dir)) 
+    if(r <= n && above(pq, pq->arrHeap[r]->priority, pq->arrHeap[l]->priority)) 
       min_i = r;
-    if((pq->arrHeap[min_i]->priority * dir) > (target->priority * dir)) {
+    if(above(pq, pq->arrHeap[min_i]->priority, target->priority)) {
       pq->arrHeap[i] = pq->arrHeap[min_i];
       pq->arrHeap[i]->heapindx = i;
       i = min_i;
@@ -156,12 +159,12 @@ static void perc_down(PQ * pq, int i) {
  * Runtime:  O(log n)
  *
  */
-int pq_insert(PQ * pq, int id, double priority) {
+int pq_insert(PQ * pq, int id, pq_prio_t priority) {
   if(id < 0 || id >= pq_capacity(pq) || pq_contains(pq, id))
     return 0;
   (pq->size)++;
   int index = pq->size;
-  pq->arrHeap[index] = malloc(sizeof(NODE));
+  pq->arrHeap[index] = &(pq->pool[id]);
   pq->arrHeap[index]->priority = priority;
   pq->arrHeap[index]->id = id;
   pq->arrID[id] = &(pq->arrHeap[index]->heapindx);
@@ -182,17 +185,16 @@ int pq_insert(PQ * pq, int id, double priority) {
  * Runtime:  O(log n)
  *       
  */
-int pq_change_priority(PQ * pq, int id, double new_priority) {
+int pq_change_priority(PQ * pq, int id, pq_prio_t new_priority) {
   if(id < 0 || id > pq->capacity || !pq_contains(pq, id))
     return 0;
-  double old_priority;
-  int dir = pq->dir;
+  pq_prio_t old_priority;
   int index = *(pq->arrID[id]);
   NODE *target = pq->arrHeap[index];
   old_priority = target->priority;
   target->priority = new_priority;
   
-  if((old_priority * dir) > (new_priority * dir)) 
+  if(above(pq, old_priority, new_priority)) 
       perc_down(pq, index);
     else 
       perc_up(pq, index);
@@ -214,12 +216,10 @@ int pq_remove_by_id(PQ * pq, int id) {
   if(id < 0 || id > pq->capacity || !pq_contains(pq, id))
     return 0;
   int index = *(pq->arrID[id]);
-  NODE *target = pq->arrHeap[index];
   pq->arrHeap[index] = pq->arrHeap[pq->size];
   //  pq->arrHeap[pq->size] = NULL;
   perc_down(pq, index);
   pq->arrID[id] = NULL;
-  free(target);
   (pq->size)--;
   return 1;
 }
@@ -236,7 +236,7 @@ int pq_remove_by_id(PQ * pq, int id) {
  * Runtime:  O(1)
  *
  */
-int pq_get_priority(PQ * pq, int id, double *priority) {
+int pq_get_priority(PQ * pq, int id, pq_prio_t *priority) {
   if(pq_contains(pq, id)) {
     *priority = pq->arrHeap[*(pq->arrID[id])]->priority;
     return 1;
@@ -260,7 +260,7 @@ int pq_get_priority(PQ * pq, int id, double *priority) {
  *
  *
  */
-int pq_delete_top(PQ * pq, int *id, double *priority) {
+int pq_delete_top(PQ * pq, int *id, pq_prio_t *priority) {
   if(pq->size <= 0)
     return 0;
   *id = pq->arrHeap[1]->id;
@@ -271,6 +271,23 @@ int pq_delete_top(PQ * pq, int *id, double *priority) {
   return ret;
 }
 
+/**
+ * Function: pq_clear
+ * Parameters: priority queue pq
+ * Returns: --
+ * Desc: removes all entries; the queue keeps its capacity and
+ *       can be reused.
+ *
+ * Runtime:  O(size)
+ *
+ */
+void pq_clear(PQ * pq) {
+  int i;
+  for(i = 1; i <= pq->size; i++)
+    pq->arrID[pq->arrHeap[i]->id] = NULL;
+  pq->size = 0;
+}
+
 /**
  * Function:  pq_capacity
  * Parameters: priority queue pq
@@ -17,6 +17,13 @@
 // "Opaque type" -- definition of pq_struct hidden in pq.c
 typedef struct pq_struct PQ;
 
+// Priority type; pq.c and its clients must be built with the same
+//   -DPQ_PRIORITY_T=... (the graph code sets it through WEIGHT).
+#ifndef PQ_PRIORITY_T
+#define PQ_PRIORITY_T double
+#endif
+typedef PQ_PRIORITY_T pq_prio_t;
+
 
 /**
  * Function: pq_create
@@ -55,7 +62,7 @@ extern void pq_free(PQ * pq);
  * Runtime:  O(log n)
  *
  */
-extern int pq_insert(PQ * pq, int id, double priority);
+extern int pq_insert(PQ * pq, int id, pq_prio_t priority);
 
 /**
  * Function: pq_change_priority
@@ -70,7 +77,7 @@ extern int pq_insert(PQ * pq, int id, double priority);
  * Runtime:  O(log n)
  *       
  */
-extern int pq_change_priority(PQ * pq, int id, double new_priority);
+extern int pq_change_priority(PQ * pq, int id, pq_prio_t new_priority);
 
 /**
  * Function: pq_remove_by_id
@@ -97,7 +104,7 @@ extern int pq_remove_by_id(PQ * pq, int id);
  * Runtime:  O(1)
  *
  */
-extern int pq_get_priority(PQ * pq, int id, double *priority);
+extern int pq_get_priority(PQ * pq, int id, pq_prio_t *priority);
 
 /**
  * Function: pq_delete_top
@@ -115,7 +122,19 @@ extern int pq_get_priority(PQ * pq, int id, double *priority);
  *
  *
  */
-extern int pq_delete_top(PQ * pq, int *id, double *priority);
+extern int pq_delete_top(PQ * pq, int *id, pq_prio_t *priority);
+
+/**
+ * Function: pq_clear
+ * Parameters: priority queue pq
+ * Returns: --
+ * Desc: removes all entries; the queue keeps its capacity and
+ *       can be reused.
+ *
+ * Runtime:  O(size)
+ *
+ */
+extern void pq_clear(PQ * pq);
 
 /**
  * Function:  pq_capacity
@@ -225,6 +225,54 @@ void permute_test_get_priority(double *array, int *testtotal, int *testfail, int
   return;
 }
 
+void test_clear(double *array, int *testtotal, int *testfail, int length) {
+  int c, id;
+  PQ *pq = pq_create(length, 1);
+  double *result = malloc(sizeof(double) * length);
+  double *sorted = copy_arr(array, length);
+  double priority;
+
+  /* partly fill, take some out, then clear */
+  for(c = 0; c < length; c++)
+    pq_insert(pq, c, array[length - 1 - c]);
+  pq_delete_top(pq, &id, &priority);
+  pq_delete_top(pq, &id, &priority);
+  pq_clear(pq);
+  if(pq_size(pq) != 0 || pq_capacity(pq) != length ||
+     pq_delete_top(pq, &id, &priority) != 0) {
+    printf("\nFUNC: clear\nQUEUE NOT EMPTY AFTER CLEAR\n");
+    (*testfail)++;
+  }
+  (*testtotal)++;
+  for(c = 0; c < length; c++)
+    if(pq_contains(pq, c) || pq_get_priority(pq, c, &priority)) {
+      printf("\nFUNC: clear\nID %i STILL PRESENT\n", c);
+      (*testfail)++;
+      break;
+    }
+  (*testtotal)++;
+
+  /* reuse: the same ids go in again with new priorities */
+  for(c = 0; c < length; c++)
+    if(!pq_insert(pq, c, array[c])) {
+      printf("\nFUNC: clear\nREINSERT OF ID %i REFUSED\n", c);
+      (*testfail)++;
+      break;
+    }
+  for(c = 0; c < length; c++)
+    pq_delete_top(pq, &id, &(result[c]));
+  qsort(sorted, length, sizeof(double), cmp_double);
+  if(pq_size(pq) != 0 || !arr_double_equal(sorted, result, length)) {
+    print_func_info("clear", array, sorted, result, 1, length);
+    (*testfail)++;
+  }
+  (*testtotal)++;
+
+  free(result);
+  free(sorted);
+  pq_free(pq);
+}
+
 main() {
   int i;
 
@@ -276,6 +324,7 @@ main() {
   permute_test_delete_top(test, &testt, &testf, 0, n);
   permute_test_change_priority(test, &testt, &testf, 0, n); 
   permute_test_get_priority(test, &testt, &testf, 0, n);
+  test_clear(test, &testt, &testf, n);
   int testp = testt - testf;
   printf("\n%i/%i PASSED\n", testp, testt);
   free(test);
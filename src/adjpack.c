@@ -0,0 +1,355 @@
+/**
+ * Packed adjacency (ADJ_PACKED, see graph_impl.h).
+ *
+ * A list node costs a 32-byte malloc chunk per directed edge.  The
+ *   packed form stores, per vertex, its edges sorted by neighbor id
+ *   as varint id deltas (1-2 bytes on a well ordered graph, see
+ *   g_reorder) each followed by its weight, in one block indexed by
+ *   a per-vertex byte offset.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define LIST_NODE_BYTES 32   // malloc chunk of one LST_NODE on glibc
+#define FIXED16_MAX 65535
+
+static int cmp_edge(const void *a, const void *b) {
+  const EDGE_REC *x = a, *y = b;
+  if(x->v != y->v)
+    return x->v - y->v;
+  return x->w < y->w ? -1 : x->w > y->w;
+}
+
+static unsigned char * put_varint(unsigned char *b, unsigned x) {
+  while(x >= 0x80) {
+    *b++ = (x & 0x7f) | 0x80;
+    x >>= 7;
+  }
+  *b++ = x;
+  return b;
+}
+
+EDGE_REC * adj_flatten(GRAPH *g, int *order, int *newid, long **start) {
+  long m = 0;
+  int k, u, v;
+  weight_t w;
+  EDGE_REC *e;
+  EDGE_IT it;
+
+  for(u = 0; u < g->n; u++)
+    m += g->vertices[u].out_degree;
+  e = malloc(sizeof(EDGE_REC) * (m > 0 ? m : 1));
+  *start = malloc(sizeof(long) * (g->n + 1));
+  m = 0;
+  for(k = 0; k < g->n; k++) {
+    (*start)[k] = m;
+    u = order != NULL ? order[k] : k;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      e[m].v = newid != NULL ? newid[v] : v;
+      e[m++].w = weight_to_double(w);
+    }
+  }
+  (*start)[g->n] = m;
+  if(tile_failed(g)) {
+    free(e);
+    free(*start);
+    return NULL;
+  }
+  return e;
+}
+
+void adj_drop_derived(GRAPH *g) {
+  free(g->rev_off);
+  free(g->rev_adj);
+  free(g->rev_w);
+  g->rev_off = NULL;
+  g->rev_adj = NULL;
+  g->rev_w = NULL;
+  if(g->chains != NULL)
+    chains_free(g->chains);
+  g->chains = NULL;
+  if(g->fringe != NULL)
+    fringe_free(g->fringe);
+  g->fringe = NULL;
+}
+
+void adj_free(GRAPH *g) {
+  LST_NODE *p, *next;
+  int u;
+
+  if(g->adj_mode == ADJ_PACKED) {
+    free(g->pk->bytes);
+    free(g->pk->off);
+    free(g->pk);
+    g->pk = NULL;
+  }
+  if(g->adj_mode == ADJ_TILED) {
+    tile_close(g->tiles);
+    g->tiles = NULL;
+  }
+  if(g->adj_mode == ADJ_CSR) {
+    free(g->csr_off);
+    free(g->csr_adj);
+    free(g->csr_w);
+    g->csr_off = NULL;
+    g->csr_adj = NULL;
+    g->csr_w = NULL;
+  }
+  for(u = 0; u < g->n; u++) {
+    for(p = g->vertices[u].neighbors; p != NULL; p = next) {
+      next = p->next;
+      free(p);
+    }
+    g->vertices[u].neighbors = NULL;
+  }
+  g->adj_mode = ADJ_LIST;
+  g->edge_gen++;
+  adj_drop_derived(g);
+}
+
+/* in-edges of each vertex in order of tail */
+void adj_reverse(GRAPH *g) {
+  EDGE_IT it;
+  weight_t w;
+  long *off, k;
+  int u, v;
+
+  // rev_off is stored last, so a non-NULL one means the rest is there
+  if(!g->directed || g->adj_mode == ADJ_TILED
+     || __atomic_load_n(&g->rev_off, __ATOMIC_ACQUIRE) != NULL)
+    return;
+  pthread_mutex_lock(&g->rev_lock);
+  if(g->rev_off != NULL) {   // another thread got here first
+    pthread_mutex_unlock(&g->rev_lock);
+    return;
+  }
+  off = calloc(g->n + 1, sizeof(long));
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      off[v+1]++;
+  }
+  for(u = 0; u < g->n; u++)
+    off[u+1] += off[u];
+  g->rev_adj = malloc(sizeof(int) * (off[g->n] > 0 ? off[g->n] : 1));
+  g->rev_w = malloc(sizeof(weight_t) * (off[g->n] > 0 ? off[g->n] : 1));
+  // off[v] walks up to the end of v's range, then is shifted back
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      k = off[v]++;
+      g->rev_adj[k] = u;
+      g->rev_w[k] = w;
+    }
+  }
+  for(u = g->n; u > 0; u--)
+    off[u] = off[u-1];
+  off[0] = 0;
+  __atomic_store_n(&g->rev_off, off, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&g->rev_lock);
+}
+
+void adj_pack(GRAPH *g, EDGE_REC *e, long *start, int wfmt) {
+  PACKED_ADJ *pk = malloc(sizeof(PACKED_ADJ));
+  long m = start[g->n], i;
+  size_t wbytes = wfmt == G_WEIGHT_FLOAT ? sizeof(float) : sizeof(unsigned short);
+  double maxw = 0;
+  unsigned char *b;
+  int u, prev;
+
+  for(i = 0; i < m; i++)
+    if(e[i].w > maxw)
+      maxw = e[i].w;
+  pk->wfmt = wfmt;
+#ifdef WEIGHT_UINT
+  // a whole number of weight units, so that decoding is an integer
+  //   multiply (and exact while weights fit in 16 bits)
+  pk->wstep = ((unsigned long long)weight_from_double(maxw) + FIXED16_MAX - 1)
+    / FIXED16_MAX;
+  pk->wscale = pk->wstep / WEIGHT_UNIT;
+#else
+  pk->wscale = maxw > 0 ? maxw / FIXED16_MAX : 1;
+  pk->wstep = pk->wscale;
+#endif
+  pk->off = malloc(sizeof(size_t) * (g->n + 1));
+  // worst case 5 varint bytes per edge; trimmed below
+  pk->bytes = malloc(m * (5 + wbytes) + 1);
+
+  b = pk->bytes;
+  for(u = 0; u < g->n; u++) {
+    qsort(e + start[u], start[u+1] - start[u], sizeof(EDGE_REC), cmp_edge);
+    pk->off[u] = b - pk->bytes;
+    for(i = start[u], prev = 0; i < start[u+1]; i++) {
+      b = put_varint(b, e[i].v - prev);
+      prev = e[i].v;
+      if(wfmt == G_WEIGHT_FLOAT) {
+	float f = e[i].w;
+	memcpy(b, &f, sizeof(f));
+      }
+      else {
+	// round to nearest, but never down to a zero weight
+	long q = (long)(e[i].w / pk->wscale + 0.5);
+	unsigned short s = q < 1 ? 1 : q > FIXED16_MAX ? FIXED16_MAX : q;
+#ifdef WEIGHT_UINT
+	if((unsigned long long)s * pk->wstep >= UINT_MAX)  // below DIST_INF
+	  s--;
+#endif
+	memcpy(b, &s, sizeof(s));
+      }
+      b += wbytes;
+    }
+  }
+  pk->off[g->n] = b - pk->bytes;
+  pk->bytes = realloc(pk->bytes, pk->off[g->n] + 1);
+
+  adj_free(g);
+  for(u = 0; u < g->n; u++)
+    g->vertices[u].out_degree = start[u+1] - start[u];
+  g->pk = pk;
+  g->adj_mode = ADJ_PACKED;
+  g->vhash_valid = 0;
+}
+
+void adj_csr(GRAPH *g, EDGE_REC *e, long *start) {
+  long m = start[g->n], i;
+  long *off = malloc(sizeof(long) * (g->n + 1));
+  int *adj = malloc(sizeof(int) * (m > 0 ? m : 1));
+  weight_t *w = malloc(sizeof(weight_t) * (m > 0 ? m : 1));
+  int u;
+
+  for(i = 0; i < m; i++) {
+    adj[i] = e[i].v;
+    w[i] = weight_from_double(e[i].w);
+  }
+  memcpy(off, start, sizeof(long) * (g->n + 1));
+  adj_free(g);
+  for(u = 0; u < g->n; u++)
+    g->vertices[u].out_degree = start[u+1] - start[u];
+  g->csr_off = off;
+  g->csr_adj = adj;
+  g->csr_w = w;
+  g->adj_mode = ADJ_CSR;
+  g->vhash_valid = 0;
+}
+
+int g_compress(GRAPH *g, int wfmt) {
+  EDGE_REC *e;
+  long *start;
+
+  if(wfmt != G_WEIGHT_FLOAT && wfmt != G_WEIGHT_FIXED16)
+    return 0;
+  if((e = adj_flatten(g, NULL, NULL, &start)) == NULL)
+    return 0;
+  adj_pack(g, e, start, wfmt);
+  free(e);
+  free(start);
+  return 1;
+}
+
+unsigned long g_adj_bytes(GRAPH *g) {
+  unsigned long m = 0, rev = 0;
+  int u;
+
+  if(g->rev_off != NULL)
+    rev = (g->n + 1) * sizeof(long)
+      + g->rev_off[g->n] * (sizeof(int) + sizeof(weight_t));
+  if(g->adj_mode == ADJ_TILED)
+    return rev + tile_bytes(g->tiles);
+  if(g->adj_mode == ADJ_PACKED)
+    return rev + sizeof(PACKED_ADJ) + (g->n + 1) * sizeof(size_t)
+      + g->pk->off[g->n];
+  if(g->adj_mode == ADJ_CSR)
+    return rev + (g->n + 1) * sizeof(long)
+      + g->csr_off[g->n] * (sizeof(int) + sizeof(weight_t));
+  for(u = 0; u < g->n; u++)
+    m += g->vertices[u].out_degree;
+  return rev + m * LIST_NODE_BYTES;
+}
+
+/* weight of every edge u -> v set to w; returns how many there were */
+static int set_weight(GRAPH *g, int u, int v, double w) {
+  LST_NODE *p;
+  unsigned char *b;
+  unsigned x, c;
+  long i;
+  float f;
+  int k, sh, prev = 0, found = 0;
+
+  if(g->adj_mode == ADJ_LIST) {
+    for(p = g->vertices[u].neighbors; p != NULL; p = p->next)
+      if(p->id == v) {
+	p->weight = weight_from_double(w);
+	found++;
+      }
+  }
+  else if(g->adj_mode == ADJ_CSR) {
+    for(i = g->csr_off[u]; i < g->csr_off[u+1]; i++)
+      if(g->csr_adj[i] == v) {
+	g->csr_w[i] = weight_from_double(w);
+	found++;
+      }
+  }
+  else {
+    // same walk as edge_next, keeping a pointer to the weight
+    b = g->pk->bytes + g->pk->off[u];
+    for(k = 0; k < g->vertices[u].out_degree; k++) {
+      x = *b++;
+      if(x & 0x80) {
+	x &= 0x7f;
+	sh = 7;
+	do {
+	  c = *b++;
+	  x |= (c & 0x7f) << sh;
+	  sh += 7;
+	} while(c & 0x80);
+      }
+      prev += x;
+      if(prev == v) {
+	f = w;
+	memcpy(b, &f, sizeof(f));
+	found++;
+      }
+      b += sizeof(f);
+    }
+  }
+  if(g->rev_off != NULL)
+    for(i = g->rev_off[v]; i < g->rev_off[v+1]; i++)
+      if(g->rev_adj[i] == u)
+	g->rev_w[i] = weight_from_double(w);
+  return found;
+}
+
+int g_set_edge_weight(GRAPH *g, char *src, char *dest, double weight) {
+  int u, v, found;
+
+  u = g_lookup_id(g, src);
+  v = g_lookup_id(g, dest);
+  if(u == -1 || v == -1) {
+    fprintf(stderr, "error: invalid vertex for set_edge_weight\n");
+    return -1;
+  }
+  if(g->adj_mode == ADJ_TILED ||
+     (g->adj_mode == ADJ_PACKED && g->pk->wfmt != G_WEIGHT_FLOAT))
+    return -1;
+  found = set_weight(g, u, v, weight);
+  if(!g->directed && u != v)
+    set_weight(g, v, u, weight);   // the same edge, stored at v
+  if(found > 0) {
+    // the shortcuts of g_contract_chains/g_peel_fringe hold old sums
+    if(g->chains != NULL)
+      chains_free(g->chains);
+    g->chains = NULL;
+    if(g->fringe != NULL)
+      fringe_free(g->fringe);
+    g->fringe = NULL;
+    g->vhash_valid = 0;
+    g->edge_gen++;
+  }
+  return found;
+}
@@ -0,0 +1,490 @@
+/**
+ * Arc flags.
+ *
+ * The vertices are cut into regions (a one-level partition from
+ *   partition.c) and every edge gets one bit per region: set if the
+ *   edge starts some shortest path into that region.  A query towards
+ *   src then only follows the edges flagged for src's region, which
+ *   keeps the search near the shortest path once it is far from src.
+ *
+ * Edges inside a region are flagged for it.  For the rest, a shortest
+ *   path into region R enters it through one of R's entry vertices
+ *   (those with an in-edge from another region), so a full Dijkstra
+ *   backward from each entry vertex b flags for R every edge (u, v)
+ *   with d(u) = w + d(v): those are the edges on shortest paths to b.
+ *   The entry vertices are searched from in parallel; flags are set
+ *   with an atomic or.  This is the expensive part (one full search
+ *   per entry vertex), hence g_arcflags_save.
+ *
+ * Flags are rbytes bytes per edge, edges numbered in the order
+ *   edge_begin gives them: the i-th edge of u is eoff[u] + i.
+ *
+ * File layout (native byte order):
+ *
+ *   AF_HDR
+ *   int32 region[n]
+ *   uint8 flags[m * rbytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "pq.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define MAX_THREADS 64
+#define DEFAULT_REGIONS 32
+
+#define AF_MAGIC "ARCFLAG"
+#define AF_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  int32_t nregions;
+  int32_t n;
+  int32_t unused;
+  int64_t m;
+  uint64_t ghash;        // g_version_hash of the graph
+} AF_HDR;
+
+typedef struct {
+  int *items;
+  int n;
+  int cap;
+} IVEC;
+
+struct arcflags {
+  GRAPH *g;
+  int nregions;
+  int rbytes;              // flag bytes per edge
+  int *region;             // of each vertex
+  long *eoff;              // flags of u's i-th edge at
+  unsigned char *flags;    //   flags[(eoff[u] + i) * rbytes]
+  unsigned long edge_gen;  // of g when the flags were made
+  PQ *q;                   // query search, by vertex
+  dist_t *sd;
+  int *spar;
+  unsigned *sstamp;
+  unsigned sepoch;
+  dist_t *d;               // the report
+  int *pred;
+  unsigned *stamp;
+  unsigned epoch;
+  PATH_RPT rpt;
+};
+
+typedef struct precomp PRECOMP;
+
+typedef struct {
+  PRECOMP *pc;
+  pthread_t tid;
+  PQ *q;
+  dist_t *d;
+  unsigned *stamp;
+  unsigned epoch;
+  IVEC settled;
+} WORKER;
+
+struct precomp {
+  ARCFLAGS *af;
+  int *entry;       // entry vertices, searched from one at a time
+  int nentry;
+  int next;         // next unclaimed one
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static void ivec_push(IVEC *v, int x) {
+  if(v->n == v->cap) {
+    v->cap = v->cap == 0 ? 64 : 2*v->cap;
+    v->items = realloc(v->items, v->cap*sizeof(int));
+  }
+  v->items[v->n++] = x;
+}
+
+static void set_flag(ARCFLAGS *af, long e, int r) {
+  unsigned char *p = af->flags + e * af->rbytes + r / 8, bit = 1 << (r % 8);
+
+  if(!(__atomic_load_n(p, __ATOMIC_RELAXED) & bit))
+    __atomic_fetch_or(p, bit, __ATOMIC_RELAXED);
+}
+
+static int has_flag(ARCFLAGS *af, long e, int r) {
+  return af->flags[e * af->rbytes + r / 8] & (1 << (r % 8));
+}
+
+static ARCFLAGS * af_new(GRAPH *g, int nregions) {
+  ARCFLAGS *af = calloc(1, sizeof(ARCFLAGS));
+  int n = g->n, u;
+
+  af->g = g;
+  af->nregions = nregions;
+  af->rbytes = (nregions + 7) / 8;
+  af->eoff = malloc(sizeof(long) * (n + 1));
+  af->eoff[0] = 0;
+  for(u = 0; u < n; u++)
+    af->eoff[u+1] = af->eoff[u] + g->vertices[u].out_degree;
+  af->flags = calloc(af->eoff[n] * af->rbytes + 1, 1);
+  af->edge_gen = g->edge_gen;
+
+  af->q = pq_create(n > 0 ? n : 1, 1);
+  af->sd = malloc(sizeof(dist_t) * (n > 0 ? n : 1));
+  af->spar = malloc(sizeof(int) * (n > 0 ? n : 1));
+  af->sstamp = calloc(n > 0 ? n : 1, sizeof(unsigned));
+  af->d = malloc(sizeof(dist_t) * (n > 0 ? n : 1));
+  af->pred = malloc(sizeof(int) * (n > 0 ? n : 1));
+  af->stamp = calloc(n > 0 ? n : 1, sizeof(unsigned));
+  af->rpt.g = g;
+  af->rpt.s = -1;
+  af->rpt.d = af->d;
+  af->rpt.pred = af->pred;
+  af->rpt.stamp = af->stamp;
+  af->rpt.epoch = 0;
+  af->rpt.ctx_owned = 1;
+  af->rpt.df = NULL;
+  af->rpt.dd = NULL;
+  af->rpt.map = NULL;
+  return af;
+}
+
+/* flags for b's region the edges on shortest paths to b */
+static void flag_from(ARCFLAGS *af, WORKER *wk, int b) {
+  GRAPH *g = af->g;
+  dist_t du, dv;
+  weight_t w;
+  EDGE_IT it;
+  long e;
+  int u, v, i, r = af->region[b];
+
+  if(++wk->epoch == 0) {
+    memset(wk->stamp, 0, sizeof(unsigned) * g->n);
+    wk->epoch = 1;
+  }
+  wk->settled.n = 0;
+  wk->stamp[b] = wk->epoch;
+  wk->d[b] = 0;
+  pq_insert(wk->q, b, 0);
+  while(pq_delete_top(wk->q, &u, &du)) {
+    ivec_push(&wk->settled, u);
+    edge_begin_in(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      dv = dist_add(du, w);
+      if(wk->stamp[v] != wk->epoch) {
+	wk->stamp[v] = wk->epoch;
+	wk->d[v] = dv;
+	pq_insert(wk->q, v, dv);
+      }
+      else if(dv < wk->d[v] && pq_contains(wk->q, v)) {
+	wk->d[v] = dv;
+	pq_change_priority(wk->q, v, dv);
+      }
+    }
+  }
+  for(i = 0; i < wk->settled.n; i++) {
+    u = wk->settled.items[i];
+    edge_begin(g, u, &it);
+    for(e = af->eoff[u]; edge_next(&it, &v, &w); e++)
+      if(wk->stamp[v] == wk->epoch && dist_add(wk->d[v], w) == wk->d[u])
+	set_flag(af, e, r);
+  }
+}
+
+static void *worker_main(void *arg) {
+  WORKER *wk = arg;
+  PRECOMP *pc = wk->pc;
+  int i;
+
+  while((i = __atomic_fetch_add(&pc->next, 1, __ATOMIC_RELAXED))
+	< pc->nentry)
+    flag_from(pc->af, wk, pc->entry[i]);
+  return NULL;
+}
+
+/* 1 if v has an in-edge from another region */
+static int is_entry(ARCFLAGS *af, int v) {
+  EDGE_IT it;
+  weight_t w;
+  int u;
+
+  edge_begin_in(af->g, v, &it);
+  while(edge_next(&it, &u, &w))
+    if(af->region[u] != af->region[v])
+      return 1;
+  return 0;
+}
+
+static void new_search(ARCFLAGS *af) {
+  if(++af->sepoch == 0) {
+    memset(af->sstamp, 0, sizeof(unsigned) * af->g->n);
+    af->sepoch = 1;
+  }
+}
+
+static void q_reach(ARCFLAGS *af, int v, dist_t dv, int u) {
+  if(af->sstamp[v] != af->sepoch) {
+    af->sstamp[v] = af->sepoch;
+    af->sd[v] = dv;
+    af->spar[v] = u;
+    pq_insert(af->q, v, dv);
+  }
+  else if(dv < af->sd[v] && pq_contains(af->q, v)) {
+    af->sd[v] = dv;
+    af->spar[v] = u;
+    pq_change_priority(af->q, v, dv);
+  }
+}
+
+/* the lightest edge u -> v */
+static weight_t edge_weight(GRAPH *g, int u, int v) {
+  weight_t w, best = 0;
+  EDGE_IT it;
+  int x, found = 0;
+
+  edge_begin(g, u, &it);
+  while(edge_next(&it, &x, &w))
+    if(x == v && (!found || w < best)) {
+      best = w;
+      found = 1;
+    }
+  return best;
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+ARCFLAGS * g_arcflags_create(GRAPH *g, int nregions, int nthreads) {
+  ARCFLAGS *af;
+  PARTITION *p;
+  PRECOMP pc;
+  WORKER *workers;
+  EDGE_IT it;
+  weight_t w;
+  long maxsize, e;
+  int n = g->n, u, v, t;
+
+  adj_reverse(g);   // the searches from the entries run backwards
+  if(nregions <= 0)
+    nregions = DEFAULT_REGIONS;
+  maxsize = n > nregions ? (n + nregions - 1) / nregions : 1;
+  p = part_build(g, 1, &maxsize);
+  af = af_new(g, p->ncells[0]);
+  af->region = p->cell[0];
+  p->cell[0] = NULL;   // now af's
+  part_free(p);
+
+  for(u = 0; u < n; u++) {
+    edge_begin(g, u, &it);
+    for(e = af->eoff[u]; edge_next(&it, &v, &w); e++)
+      if(af->region[v] == af->region[u])
+	set_flag(af, e, af->region[u]);
+  }
+
+  pc.af = af;
+  pc.entry = malloc(sizeof(int) * (n > 0 ? n : 1));
+  pc.nentry = 0;
+  pc.next = 0;
+  for(v = 0; v < n; v++)
+    if(is_entry(af, v))
+      pc.entry[pc.nentry++] = v;
+
+  if(nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if(nthreads <= 0)
+    nthreads = 1;
+  if(g->adj_mode == ADJ_TILED)   // the tile cache is not shared
+    nthreads = 1;
+  workers = calloc(nthreads, sizeof(WORKER));
+  for(t = 0; t < nthreads; t++) {
+    workers[t].pc = &pc;
+    workers[t].q = pq_create(n > 0 ? n : 1, 1);
+    workers[t].d = malloc(sizeof(dist_t) * (n > 0 ? n : 1));
+    workers[t].stamp = calloc(n > 0 ? n : 1, sizeof(unsigned));
+    if(t > 0)
+      pthread_create(&workers[t].tid, NULL, worker_main, &workers[t]);
+  }
+  worker_main(&workers[0]);
+  for(t = 0; t < nthreads; t++) {
+    if(t > 0)
+      pthread_join(workers[t].tid, NULL);
+    pq_free(workers[t].q);
+    free(workers[t].d);
+    free(workers[t].stamp);
+    free(workers[t].settled.items);
+  }
+  free(workers);
+  free(pc.entry);
+  if(tile_failed(g)) {
+    g_arcflags_free(af);
+    return NULL;
+  }
+  return af;
+}
+
+PATH_RPT * g_shortest_path_arcflags(ARCFLAGS *af, char *src, char *target) {
+  GRAPH *g = af->g;
+  dist_t du;
+  weight_t w;
+  EDGE_IT it;
+  long e;
+  int s, t, u, v, r;
+
+  s = g_lookup_id(g, src);
+  if(s == -1) {
+    fprintf(stderr, "error: invalid src for shortest path\n");
+    return NULL;
+  }
+  if((t = g_lookup_id(g, target)) == -1) {
+    fprintf(stderr, "error: invalid target for shortest path\n");
+    return NULL;
+  }
+  if(af->edge_gen != g->edge_gen) {
+    fprintf(stderr, "error: graph changed since the arc flags were made\n");
+    return NULL;
+  }
+
+  // paths lead to src: search from target along the edges flagged
+  //   for src's region
+  r = af->region[s];
+  new_search(af);
+  q_reach(af, t, 0, t);
+  while(pq_delete_top(af->q, &u, &du)) {
+    if(u == s)
+      break;
+    edge_begin(g, u, &it);
+    for(e = af->eoff[u]; edge_next(&it, &v, &w); e++)
+      if(has_flag(af, e, r))
+	q_reach(af, v, dist_add(du, w), u);
+  }
+  pq_clear(af->q);
+  if(tile_failed(g))
+    return NULL;
+
+  if(++af->epoch == 0) {
+    memset(af->stamp, 0, sizeof(unsigned) * g->n);
+    af->epoch = 1;
+  }
+  af->stamp[s] = af->epoch;
+  af->d[s] = 0;
+  af->pred[s] = s;
+  af->rpt.s = s;
+  af->rpt.epoch = af->epoch;
+  if(af->sstamp[s] != af->sepoch)   // unreachable
+    return &af->rpt;
+  for(v = s; v != t; v = u) {
+    u = af->spar[v];
+    af->stamp[u] = af->epoch;
+    af->pred[u] = v;
+    af->d[u] = dist_add(af->d[v], edge_weight(g, u, v));
+  }
+  return tile_failed(g) ? NULL : &af->rpt;
+}
+
+int g_arcflags_save(ARCFLAGS *af, const char *path) {
+  AF_HDR h;
+  FILE *fp;
+  char *tmp;
+  long m = af->eoff[af->g->n];
+  int n = af->g->n, v, ok;
+
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, AF_MAGIC);
+  h.version = AF_VERSION;
+  h.nregions = af->nregions;
+  h.n = n;
+  h.m = m;
+  h.ghash = g_version_hash(af->g);
+
+  // write next to the target and rename, so readers never see half a file
+  tmp = malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+  if((fp = fopen(tmp, "wb")) == NULL) {
+    fprintf(stderr, "error: cannot write %s\n", tmp);
+    free(tmp);
+    return 0;
+  }
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  for(v = 0; v < n && ok; v++) {
+    int32_t r = af->region[v];
+    ok = fwrite(&r, sizeof(r), 1, fp) == 1;
+  }
+  if(ok && m > 0)
+    ok = fwrite(af->flags, af->rbytes, m, fp) == (size_t)m;
+  if(fclose(fp) != 0)
+    ok = 0;
+  if(ok && rename(tmp, path) != 0)
+    ok = 0;
+  if(!ok) {
+    fprintf(stderr, "error: cannot write %s\n", path);
+    remove(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+ARCFLAGS * g_arcflags_load(GRAPH *g, const char *path) {
+  ARCFLAGS *af;
+  AF_HDR h;
+  FILE *fp;
+  long m;
+  int v, ok;
+
+  if((fp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, "error: cannot open %s\n", path);
+    return NULL;
+  }
+  if(fread(&h, sizeof(h), 1, fp) != 1
+     || memcmp(h.magic, AF_MAGIC, sizeof(AF_MAGIC)) != 0
+     || h.version != AF_VERSION || h.n != g->n || h.nregions < 1) {
+    fprintf(stderr, "error: %s is not arc flags for this graph\n", path);
+    fclose(fp);
+    return NULL;
+  }
+  if(h.ghash != g_version_hash(g)) {
+    fprintf(stderr, "error: %s was computed for another version of the graph\n", path);
+    fclose(fp);
+    return NULL;
+  }
+
+  af = af_new(g, h.nregions);
+  m = af->eoff[g->n];
+  af->region = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  ok = h.m == m;
+  for(v = 0; v < g->n && ok; v++) {
+    int32_t r;
+    ok = fread(&r, sizeof(r), 1, fp) == 1 && r >= 0 && r < h.nregions;
+    af->region[v] = r;
+  }
+  if(ok && m > 0)
+    ok = fread(af->flags, af->rbytes, m, fp) == (size_t)m;
+  fclose(fp);
+  if(!ok) {
+    fprintf(stderr, "error: %s is truncated or damaged\n", path);
+    g_arcflags_free(af);
+    return NULL;
+  }
+  return af;
+}
+
+void g_arcflags_free(ARCFLAGS *af) {
+  free(af->region);
+  free(af->eoff);
+  free(af->flags);
+  pq_free(af->q);
+  free(af->sd);
+  free(af->spar);
+  free(af->sstamp);
+  free(af->d);
+  free(af->pred);
+  free(af->stamp);
+  free(af);
+}
@@ -0,0 +1,362 @@
+/**
+ * Delta-stepping single source shortest paths (Meyer & Sanders).
+ *
+ * Tentative distances are kept in buckets of width delta.  The
+ *   lowest non-empty bucket is emptied repeatedly by relaxing the
+ *   light edges (weight <= delta) of its vertices in parallel; once
+ *   it stays empty the heavy edges of every vertex removed from it
+ *   are relaxed in one more parallel phase.
+ *
+ * Relaxations use an atomic compare-and-swap min on d[], so worker
+ *   threads never take a lock.  pred[] is filled in a final parallel
+ *   pass which picks, for every vertex, the tight in-edge whose tail
+ *   has the smallest distance -- i.e. the tail that the sequential
+ *   Dijkstra in graph.c settles first -- so both engines produce the
+ *   same PATH_RPT (pred may differ only between equally short
+ *   alternatives whose tails are at exactly the same distance).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define MAX_THREADS 64
+#define CHUNK 64          // vertices claimed by a worker at a time
+#define MAX_SLOTS (1<<20) // bound on the circular bucket array
+
+#define PHASE_LIGHT 0
+#define PHASE_HEAVY 1
+#define PHASE_PRED 2
+
+typedef struct {
+  int *items;
+  int n;
+  int cap;
+} IVEC;
+
+typedef struct dstep DSTEP;
+
+typedef struct {
+  DSTEP *ds;
+  pthread_t tid;
+  IVEC out;       // vertices whose distance this worker lowered
+} WORKER;
+
+struct dstep {
+  GRAPH *g;
+  double delta;   // in weight_t units
+  dist_t *d;
+  int *pred;
+  int s;
+
+  int nthreads;
+  WORKER *workers;
+  pthread_barrier_t bar;
+  int done;
+
+  int phase;      // PHASE_LIGHT, PHASE_HEAVY or PHASE_PRED
+  int *items;     // vertices to work on (NULL: all vertices)
+  int nitems;
+  int next;       // next unclaimed index into items
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static void ivec_push(IVEC *v, int x) {
+  if(v->n == v->cap) {
+    v->cap = v->cap == 0 ? 64 : 2*v->cap;
+    v->items = realloc(v->items, v->cap*sizeof(int));
+  }
+  v->items[v->n++] = x;
+}
+
+/* lowers *p to nd if nd is smaller; returns 1 if it did */
+static int atomic_min(dist_t *p, dist_t nd) {
+  dist_t cur;
+
+  __atomic_load(p, &cur, __ATOMIC_RELAXED);
+  while(nd < cur) {
+    if(__atomic_compare_exchange(p, &cur, &nd, 1,
+				 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return 1;
+  }
+  return 0;
+}
+
+static void relax_vertex(DSTEP *ds, WORKER *w, int u) {
+  EDGE_IT it;
+  dist_t du;
+  weight_t wt;
+  double delta = ds->delta;
+  int v, heavy = (ds->phase == PHASE_HEAVY);
+
+  __atomic_load(&ds->d[u], &du, __ATOMIC_RELAXED);
+  edge_begin_in(ds->g, u, &it);
+  while(edge_next(&it, &v, &wt)) {
+    if((wt > delta) != heavy)
+      continue;
+    if(atomic_min(&ds->d[v], dist_add(du, wt)))
+      ivec_push(&w->out, v);
+  }
+}
+
+/* the tight in-edge with the smallest tail distance (lowest id on ties) */
+static void pick_pred(DSTEP *ds, int v) {
+  EDGE_IT it;
+  dist_t *d = ds->d;
+  weight_t w;
+  int u, best = -1;
+
+  if(v == ds->s) {
+    ds->pred[v] = v;
+    return;
+  }
+  if(d[v] < DIST_INF) {
+    // the search runs on in-edges, so its in-edges are v's out-edges
+    edge_begin(ds->g, v, &it);
+    while(edge_next(&it, &u, &w)) {
+      if(dist_add(d[u], w) == d[v] &&
+	 (best == -1 || d[u] < d[best] || (d[u] == d[best] && u < best)))
+	best = u;
+    }
+  }
+  ds->pred[v] = best;
+}
+
+static void work_phase(DSTEP *ds, WORKER *w) {
+  int lo, hi, i;
+
+  w->out.n = 0;
+  while((lo = __atomic_fetch_add(&ds->next, CHUNK, __ATOMIC_RELAXED))
+	< ds->nitems) {
+    hi = lo + CHUNK < ds->nitems ? lo + CHUNK : ds->nitems;
+    for(i = lo; i < hi; i++) {
+      if(ds->phase == PHASE_PRED)
+	pick_pred(ds, i);
+      else
+	relax_vertex(ds, w, ds->items[i]);
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  WORKER *w = arg;
+  DSTEP *ds = w->ds;
+
+  for(;;) {
+    pthread_barrier_wait(&ds->bar);
+    if(ds->done)
+      break;
+    work_phase(ds, w);
+    pthread_barrier_wait(&ds->bar);
+  }
+  return NULL;
+}
+
+/* runs one phase on all threads; the calling thread is worker 0 */
+static void run_phase(DSTEP *ds, int phase, int *items, int nitems) {
+  ds->phase = phase;
+  ds->items = items;
+  ds->nitems = nitems;
+  ds->next = 0;
+  pthread_barrier_wait(&ds->bar);
+  work_phase(ds, &ds->workers[0]);
+  pthread_barrier_wait(&ds->bar);
+}
+
+static long bucket_of(DSTEP *ds, int v) {
+  return (long)(ds->d[v] / ds->delta);
+}
+
+/* moves every lowered vertex into the bucket of its new distance */
+static int collect(DSTEP *ds, IVEC *slots, long nslots) {
+  int t, i, added = 0;
+
+  for(t = 0; t < ds->nthreads; t++) {
+    IVEC *out = &ds->workers[t].out;
+    for(i = 0; i < out->n; i++)
+      ivec_push(&slots[bucket_of(ds, out->items[i]) % nslots],
+		out->items[i]);
+    added += out->n;
+  }
+  return added;
+}
+
+static void settle_all(DSTEP *ds, double maxw) {
+  IVEC *slots, frontier = {NULL, 0, 0}, removed = {NULL, 0, 0};
+  int *fmark, fstamp = 0, pending, n = ds->g->n, i;
+  long *rmark, nslots, cur;
+
+  nslots = (long)(maxw / ds->delta) + 2;
+  slots = calloc(nslots, sizeof(IVEC));
+  fmark = calloc(n, sizeof(int));
+  rmark = calloc(n, sizeof(long));
+
+  ivec_push(&slots[0], ds->s);
+  pending = 1;
+  cur = 0;
+  while(pending > 0) {
+    while(slots[cur % nslots].n == 0)
+      cur++;
+    while(slots[cur % nslots].n > 0) {
+      IVEC *b = &slots[cur % nslots];
+      // entries are lazily deleted: skip vertices that have since
+      //   moved to a lower bucket and repeats within this round
+      fstamp++;
+      frontier.n = 0;
+      for(i = 0; i < b->n; i++) {
+	int v = b->items[i];
+	if(bucket_of(ds, v) != cur || fmark[v] == fstamp)
+	  continue;
+	fmark[v] = fstamp;
+	ivec_push(&frontier, v);
+	if(rmark[v] != cur + 1) {
+	  rmark[v] = cur + 1;
+	  ivec_push(&removed, v);
+	}
+      }
+      pending -= b->n;
+      b->n = 0;
+      run_phase(ds, PHASE_LIGHT, frontier.items, frontier.n);
+      pending += collect(ds, slots, nslots);
+    }
+    run_phase(ds, PHASE_HEAVY, removed.items, removed.n);
+    pending += collect(ds, slots, nslots);
+    removed.n = 0;
+    cur++;
+  }
+
+  for(i = 0; i < nslots; i++)
+    free(slots[i].items);
+  free(slots);
+  free(frontier.items);
+  free(removed.items);
+  free(fmark);
+  free(rmark);
+}
+
+/* in weight_t units */
+static double max_weight(GRAPH *g) {
+  EDGE_IT it;
+  double maxw = 0;
+  weight_t w;
+  int u, v;
+
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      if(w > maxw)
+	maxw = w;
+  }
+  return maxw;
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+/*
+ * delta = max weight / average degree (Meyer & Sanders), clamped to
+ *   [min weight, max weight]: roughly one light edge per vertex ends
+ *   up in the current bucket.
+ */
+double g_auto_delta(GRAPH *g) {
+  EDGE_IT it;
+  double minw = DBL_MAX, maxw = 0, delta;
+  weight_t w;
+  long m = 0;
+  int u, v;
+
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      if(w < minw)
+	minw = w;
+      if(w > maxw)
+	maxw = w;
+      m++;
+    }
+  }
+  if(m == 0)
+    return 1.0;
+  delta = maxw / ((double)m / g->n);
+  if(delta < minw)
+    delta = minw;
+  if(delta > maxw)
+    delta = maxw;
+  return delta / WEIGHT_UNIT;
+}
+
+PATH_RPT * g_shortest_path_delta(GRAPH *g, char *src, double delta,
+				 int nthreads) {
+  DSTEP ds;
+  PATH_RPT *ret;
+  double maxw;
+  int s, v, t;
+
+  s = g_lookup_id(g, src);
+  if(s == -1) {
+    fprintf(stderr, "error: invalid src for shortest path\n");
+    return NULL;
+  }
+  if(nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if(nthreads <= 0)
+    nthreads = 1;
+  if(g->adj_mode == ADJ_TILED)   // the tile cache is not shared
+    nthreads = 1;
+  adj_reverse(g);
+
+  maxw = max_weight(g);
+  if(delta <= 0)
+    delta = g_auto_delta(g);
+  delta *= WEIGHT_UNIT;
+  if(maxw / delta > MAX_SLOTS)
+    delta = maxw / MAX_SLOTS;
+
+  ret = create_dijk_rpt(g, s, g->n);
+  for(v = 0; v < g->n; v++)
+    ret->d[v] = DIST_INF;
+  ret->d[s] = 0;
+
+  ds.g = g;
+  ds.delta = delta;
+  ds.d = ret->d;
+  ds.pred = ret->pred;
+  ds.s = s;
+  ds.nthreads = nthreads;
+  ds.done = 0;
+  ds.workers = calloc(nthreads, sizeof(WORKER));
+  pthread_barrier_init(&ds.bar, NULL, nthreads);
+  for(t = 0; t < nthreads; t++) {
+    ds.workers[t].ds = &ds;
+    if(t > 0)
+      pthread_create(&ds.workers[t].tid, NULL, worker_main, &ds.workers[t]);
+  }
+
+  settle_all(&ds, maxw);
+  run_phase(&ds, PHASE_PRED, NULL, g->n);
+
+  ds.done = 1;
+  pthread_barrier_wait(&ds.bar);
+  for(t = 0; t < nthreads; t++) {
+    if(t > 0)
+      pthread_join(ds.workers[t].tid, NULL);
+    free(ds.workers[t].out.items);
+  }
+  pthread_barrier_destroy(&ds.bar);
+  free(ds.workers);
+  if(tile_failed(g)) {
+    rpt_free(ret);
+    return NULL;
+  }
+  return ret;
+}
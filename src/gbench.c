@@ -0,0 +1,140 @@
+/**
+ * Vertex ordering benchmark.
+ *
+ * usage:  gbench graph_file [none|bfs|rcm [list|csr|parcsr|float|fixed16 [queries]]]
+ *
+ * Loads the graph once per configuration (a few typical ones if
+ *   none is named), loaded as lists or as CSR (g_from_stream_csr,
+ *   or g_from_file_parallel on all CPUs for parcsr), reorders and
+ *   compresses it (g_compress) as asked
+ *   and reports the load time, the adjacency bytes per edge, how close neighbors
+ *   sit in memory and the time of full shortest path queries from
+ *   random sources.
+ *   Locality is the mean index distance |u - v| over all edges and
+ *   the share of edges whose endpoints' d[] entries share a cache
+ *   line.  To count cache misses directly, run a single ordering
+ *   under perf:
+ *
+ *     perf stat -e cache-misses ./gbench graph.txt rcm list
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define DEFAULT_QUERIES 20
+#define LINE_DOUBLES 8    // d[] entries per 64-byte cache line
+
+static const char *methods[] = { "none", "bfs", "rcm" };
+static const int method_ids[] = { -1, G_ORDER_BFS, G_ORDER_RCM };
+#define NUM_STORAGES 5
+static const char *storages[] = { "list", "csr", "float", "fixed16", "parcsr" };
+static const int storage_ids[] = { -1, -1, G_WEIGHT_FLOAT, G_WEIGHT_FIXED16, -1 };
+
+// configurations run when none is given: {ordering, storage}
+static const int defaults[][2] = { {0, 0}, {0, 1}, {0, 4}, {1, 0}, {2, 0}, {2, 1},
+				   {2, 2}, {2, 3} };
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static int lookup(const char **tbl, int n, char *name) {
+  int i;
+  for(i = 0; i < n; i++)
+    if(strcmp(name, tbl[i]) == 0)
+      return i;
+  return -1;
+}
+
+static void run(char *fname, int m, int st, int queries) {
+  FILE *fp = fopen(fname, "r");
+  GRAPH *g;
+  QUERY_CTX *ctx;
+  EDGE_IT it;
+  double gap = 0, tl, t0, t1, t2;
+  weight_t w;
+  long edges = 0, near = 0;
+  int u, v, q;
+
+  g = NULL;
+  tl = now();
+  if(st == 4)
+    g = g_from_file_parallel(fname, 0);
+  else if(fp != NULL)
+    g = st == 1 ? g_from_stream_csr(fp) : g_from_stream(fp);
+  tl = now() - tl;
+  if(g == NULL) {
+    fprintf(stderr, "gbench: cannot load %s\n", fname);
+    if(fp != NULL)
+      fclose(fp);
+    exit(1);
+  }
+  if(fp != NULL)
+    fclose(fp);
+
+  t0 = now();
+  if(method_ids[m] >= 0)
+    g_reorder(g, method_ids[m]);
+  if(storage_ids[st] >= 0)
+    g_compress(g, storage_ids[st]);
+  t1 = now();
+
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      gap += abs(u - v);
+      near += u / LINE_DOUBLES == v / LINE_DOUBLES;
+      edges++;
+    }
+  }
+
+  // the same sources for every ordering: ids do not change
+  ctx = g_query_ctx_create(g);
+  srand(1);
+  t2 = now();
+  for(q = 0; q < queries; q++)
+    g_shortest_path_ctx(ctx, (char*)g_vertex_name(g, rand() % g->n), NULL);
+  t2 = now() - t2;
+
+  printf("%-6s %-8s %10.1f %10.2f %10.1f %9.1f%% %12.3f %12.3f\n", methods[m],
+	 storages[st], tl * 1e3, edges > 0 ? (double)g_adj_bytes(g) / edges : 0.0,
+	 edges > 0 ? gap / edges : 0.0, edges > 0 ? 100.0 * near / edges : 0.0,
+	 (t1 - t0) * 1e3, t2 * 1e3 / (queries > 0 ? queries : 1));
+  g_query_ctx_free(ctx);
+  g_free(g);
+}
+
+int main(int argc, char *argv[]) {
+  int i, m = -1, st = 0, queries = DEFAULT_QUERIES;
+
+  if(argc < 2) {
+    printf("usage:  gbench graph_file [none|bfs|rcm [list|csr|parcsr|float|fixed16 [queries]]]\n");
+    return 0;
+  }
+  if(argc > 2 && (m = lookup(methods, 3, argv[2])) < 0) {
+    fprintf(stderr, "gbench: unknown ordering %s\n", argv[2]);
+    return 1;
+  }
+  if(argc > 3 && (st = lookup(storages, NUM_STORAGES, argv[3])) < 0) {
+    fprintf(stderr, "gbench: unknown storage %s\n", argv[3]);
+    return 1;
+  }
+  if(argc > 4)
+    queries = atoi(argv[4]);
+
+  printf("%-6s %-8s %10s %10s %10s %10s %12s %12s\n", "order", "storage",
+	 "load ms", "bytes/edge", "mean gap", "same line", "prepare ms", "query ms");
+  if(m >= 0)
+    run(argv[1], m, st, queries);
+  else
+    for(i = 0; i < (int)(sizeof(defaults) / sizeof(defaults[0])); i++)
+      run(argv[1], defaults[i][0], defaults[i][1], queries);
+  return 0;
+}
@@ -2,101 +2,223 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <sys/mman.h>
 #include "hmap.h"
+#include "mphf.h"
 #include "pq.h"
 #include "graph.h"
+#include "graph_impl.h"
 
-typedef struct lst_node {
-  int id;
-  double weight;
-  struct lst_node *next;
-} LST_NODE;
+_Static_assert(_Generic((pq_prio_t)0, dist_t: 1, default: 0),
+	       "PQ_PRIORITY_T must match the weight precision");
 
-typedef struct vertex_t {
-  char *name;
-  int id;
-  int out_degree;
-  LST_NODE *neighbors;
-} VERTEX;
 
-struct dijk_rpt {
-  GRAPH *g;
-  int s;
-  double *d;
-  int *pred;
-};
+static int getID(GRAPH *g, char *name);
 
-struct graph {
-  int n;              // Size of graph
-  VERTEX *vertices;   // Array of vertices
-  HMAP_PTR idmap;
-};
+int g_size(GRAPH *g) {
 
+  return g->n;
 
+}
 
-int g_size(GRAPH *g) {
 
-  return g->n;
 
+int g_is_directed(GRAPH *g) {
+  return g->directed;
 }
 
 
 
 int g_contains(GRAPH *g, char *name) {
-  return hmap_contains(g->idmap, name);
+  return getID(g, name) != -1;
 }
 
 
 
+/*
+ * Appends name to the pool and points vertex id at it.  A full pool
+ *   moves to a larger block; names of vertices below id are rebased
+ *   by their offsets, taken while the old block is still allocated.
+ */
+void g_intern_name(GRAPH *g, int id, char *name) {
+  size_t len = strlen(name) + 1;
+  char *old = g->pool;
+  int k;
+
+  if(g->pool_len + len > g->pool_cap) {
+    while(g->pool_len + len > g->pool_cap)
+      g->pool_cap *= 2;
+    g->pool = malloc(g->pool_cap);
+    memcpy(g->pool, old, g->pool_len);
+    for(k = 0; k < id; k++)
+      if(g->vertices[k].name != NULL)
+	g->vertices[k].name = g->pool + (g->vertices[k].name - old);
+    free(old);
+  }
+  memcpy(g->pool + g->pool_len, name, len);
+  g->vertices[id].name = g->pool + g->pool_len;
+  g->pool_len += len;
+}
+
 static int getNextID(GRAPH *g, char *name, int *i) {
-  int ret;
-  if(hmap_contains(g->idmap, name)) {
-    ret = *(int*)(hmap_get(g->idmap, name)); 
+  int ret, created;
+  void **slot = hmap_find_or_insert(g->idmap, name, &created);
+  if(!created) {
+    ret = *(int*)(*slot);
   }
   else {
     ret = *i;
-    *i += 1;
-    if(hmap_set(g->idmap, name, &(g->vertices[ret].id)) != NULL)
+    if(ret >= g->n)   // more names than the header announced
       return -1;
-    g->vertices[ret].name = strdup(name);
+    *i += 1;
+    *slot = &(g->vertices[ret].id);
+    g_intern_name(g, ret, name);
   }
   return ret;
 }
 
 static int getID(GRAPH *g, char *name) {
   int ret;
-  if(hmap_contains(g->idmap, name)) {
-    ret = *(int*)(hmap_get(g->idmap, name)); 
+  if(g->nameidx != NULL) {
+    ret = mphf_lookup(g->nameidx, name);
+    if(ret < 0)
+      return -1;
+    ret = g->mph2id[ret];
+    // the mphf maps foreign names to arbitrary slots
+    return strcmp(g->vertices[ret].name, name) == 0 ? ret : -1;
+  }
+  void *val;
+  if(hmap_lookup(g->idmap, name, &val)) {
+    ret = *(int*)val;
   }
   else
     ret = -1;
   return ret;
 }
 
-GRAPH * g_from_stream(FILE *fp) {
-  int n, i;
-  char *src, *dest;
-  double weight;
-  GRAPH *ret;
-  LST_NODE *p;
+int g_lookup_id(GRAPH *g, char *name) {
+  return getID(g, name);
+}
 
-  if(fscanf(fp, "%i", &n) != 1 || n <= 0) {
-    fprintf(stderr, "g_from_stream failed\n");
+int g_vertex_id(GRAPH *g, const char *name) {
+  return g_ext_id(g, getID(g, (char*)name));
+}
+
+const char * g_vertex_name(GRAPH *g, int id) {
+  if(id < 0 || id >= g->n)
     return NULL;
-  }  
+  return g->vertices[g_int_id(g, id)].name;
+}
+
+/*
+ * Once loading is done the name set is fixed: replace the id map
+ *   by a minimal perfect hash over the names, which is far smaller
+ *   and answers lookups with a few bit probes and one strcmp.
+ */
+void g_freeze_names(GRAPH *g) {
+  char **names = malloc(sizeof(char*) * g->n);
+  int *ids = malloc(sizeof(int) * g->n);
+  int i, k;
+
+  for(i = 0, k = 0; i < g->n; i++) {
+    if(g->vertices[i].name != NULL) {
+      names[k] = g->vertices[i].name;
+      ids[k++] = i;
+    }
+  }
+  g->nameidx = mphf_build(names, k, 0);
+  g->mph2id = malloc(sizeof(int) * (k > 0 ? k : 1));
+  for(i = 0; i < k; i++)
+    g->mph2id[mphf_lookup(g->nameidx, names[i])] = ids[i];
+  free(names);
+  free(ids);
+  if(g->idmap != NULL)
+    hmap_free(g->idmap, 0);
+  g->idmap = NULL;
+}
+
+GRAPH * g_new(int n, int with_idmap) {
+  GRAPH *ret;
+  int i;
 
   ret = malloc(sizeof(GRAPH));
   ret->n = n;
   ret->vertices = malloc(n*sizeof(VERTEX));
-  ret->idmap = hmap_create(n, 0);
-  hmap_set_hfunc(ret->idmap, 1);
+  // sized so that loading n names never triggers a resize
+  ret->idmap = NULL;
+  if(with_idmap)
+    ret->idmap = hmap_create((unsigned)(n / DEFAULT_LFACTOR) + 1, 0);
+  ret->nameidx = NULL;
+  ret->mph2id = NULL;
+  ret->pool_cap = 16 * (size_t)n;
+  ret->pool = malloc(ret->pool_cap);
+  ret->pool_len = 0;
+  ret->nameview = NULL;
+  ret->vhash_valid = 0;
+  ret->ext2int = NULL;
+  ret->int2ext = NULL;
+  ret->coords = NULL;
+  ret->adj_mode = ADJ_LIST;
+  ret->pk = NULL;
+  ret->csr_off = NULL;
+  ret->csr_adj = NULL;
+  ret->csr_w = NULL;
+  ret->directed = 0;
+  ret->rev_off = NULL;
+  ret->rev_adj = NULL;
+  ret->rev_w = NULL;
+  pthread_mutex_init(&ret->rev_lock, NULL);
+  ret->chains = NULL;
+  ret->fringe = NULL;
+  ret->tiles = NULL;
+  ret->edge_gen = 0;
+  ret->id_gen = 0;
+  if(ret->idmap != NULL)
+    hmap_set_hfunc(ret->idmap, 1);
   for(i = 0; i < n; i++) {
     ret->vertices[i].id = i;
     ret->vertices[i].out_degree = 0;
     ret->vertices[i].name = NULL;
     ret->vertices[i].neighbors = NULL;
   }
+  return ret;
+}
 
+/*
+ * "n" or "n directed" on a line of its own; 0 if it is neither
+ */
+static int read_header(FILE *fp, int *n, int *directed) {
+  char word[16];
+  int c;
+
+  if(fscanf(fp, "%i", n) != 1 || *n <= 0)
+    return 0;
+  *directed = 0;
+  while((c = getc(fp)) == ' ' || c == '\t' || c == '\r')
+    ;
+  if(c == '\n' || c == EOF)
+    return 1;
+  ungetc(c, fp);
+  if(fscanf(fp, "%15s", word) != 1 || strcmp(word, "directed") != 0)
+    return 0;
+  *directed = 1;
+  return 1;
+}
+
+GRAPH * g_from_stream(FILE *fp) {
+  int n, i, directed;
+  char *src, *dest;
+  double weight;
+  GRAPH *ret;
+  LST_NODE *p;
+
+  if(!read_header(fp, &n, &directed)) {
+    fprintf(stderr, "g_from_stream failed\n");
+    return NULL;
+  }  
+
+  ret = g_new(n, 1);
+  ret->directed = directed;
   src = malloc(sizeof(char)*(MAX_NAME_LEN+1));
   dest = malloc(sizeof(char)*(MAX_NAME_LEN+1));
   int result;
@@ -114,14 +236,16 @@ GRAPH * g_from_stream(FILE *fp) {
 	return NULL;
       }
       p->id = destid;
-      p->weight = weight;
+      p->weight = weight_from_double(weight);
       p->next = ret->vertices[srcid].neighbors;
       ret->vertices[srcid].neighbors = p;
       ret->vertices[srcid].out_degree++;
-      
+      if(directed)
+	continue;
+
       p = malloc(sizeof(LST_NODE));
       p->id = srcid;
-      p->weight = weight;
+      p->weight = weight_from_double(weight);
       p->next = ret->vertices[destid].neighbors;
       ret->vertices[destid].neighbors = p;
       ret->vertices[destid].out_degree++;
@@ -141,6 +265,99 @@ GRAPH * g_from_stream(FILE *fp) {
 
   free(src);
   free(dest);
+  g_freeze_names(ret);
+  return ret;
+}
+
+
+
+/*
+ * Two passes over the edge list.  The first interns the names and
+ *   counts degrees, the second drops every edge straight into its
+ *   final slot of the CSR arrays.  Nothing is allocated per edge, so
+ *   peak memory is the final graph plus the name table.
+ */
+GRAPH * g_from_stream_csr(FILE *fp) {
+  int n, i, srcid, destid, result, u, directed;
+  char src[MAX_NAME_LEN+1], dest[MAX_NAME_LEN+1];
+  double weight;
+  long start, m, e, k;
+  GRAPH *ret;
+  void *val;
+
+  if(!read_header(fp, &n, &directed) || (start = ftell(fp)) < 0) {
+    fprintf(stderr, "g_from_stream_csr failed\n");
+    return NULL;
+  }
+  ret = g_new(n, 1);
+  ret->directed = directed;
+
+  // pass 1: names and degrees
+  i = 0;
+  m = 0;
+  while((result = fscanf(fp, "%s %s %lf", src, dest, &weight)) == 3) {
+    if(weight > 0 && strcmp(src, dest) != 0) {
+      srcid = getNextID(ret, src, &i);
+      destid = getNextID(ret, dest, &i);
+      if(srcid < 0 || destid < 0)
+	break;
+      ret->vertices[srcid].out_degree++;
+      m++;
+      if(!directed) {
+	ret->vertices[destid].out_degree++;
+	m++;
+      }
+    }
+    else {
+      if(weight <= 0) 
+	fprintf(stderr, "error: non-positive weight. ignoring...\n");
+      if(strcmp(src, dest) == 0)
+	fprintf(stderr, "error: self-loop. ignoring...\n");
+    }
+  }
+  if(result != EOF || fseek(fp, start, SEEK_SET) != 0) {
+    g_free(ret);
+    fprintf(stderr, "g_from_stream_csr failed\n");
+    return NULL;
+  }
+
+  // csr_off[u] starts at the end of u's range and counts down as
+  //   pass 2 fills it, ending at the start of the range
+  ret->csr_off = malloc(sizeof(long) * (n + 1));
+  ret->csr_adj = malloc(sizeof(int) * (m > 0 ? m : 1));
+  ret->csr_w = malloc(sizeof(weight_t) * (m > 0 ? m : 1));
+  ret->adj_mode = ADJ_CSR;
+  for(u = 0, e = 0; u < n; u++) {
+    e += ret->vertices[u].out_degree;
+    ret->csr_off[u] = e;
+  }
+  ret->csr_off[n] = e;
+
+  // pass 2: edges.  The checks only fail if the file changed.
+  for(e = 0; fscanf(fp, "%s %s %lf", src, dest, &weight) == 3; ) {
+    if(weight > 0 && strcmp(src, dest) != 0) {
+      if((e += directed ? 1 : 2) > m || !hmap_lookup(ret->idmap, src, &val))
+	break;
+      srcid = *(int*)val;
+      if(!hmap_lookup(ret->idmap, dest, &val))
+	break;
+      destid = *(int*)val;
+      k = --ret->csr_off[srcid];
+      ret->csr_adj[k] = destid;
+      ret->csr_w[k] = weight_from_double(weight);
+      if(directed)
+	continue;
+      k = --ret->csr_off[destid];
+      ret->csr_adj[k] = srcid;
+      ret->csr_w[k] = weight_from_double(weight);
+    }
+  }
+  if(e != m) {
+    g_free(ret);
+    fprintf(stderr, "g_from_stream_csr failed: input changed\n");
+    return NULL;
+  }
+  g_freeze_names(ret);
   return ret;
 }
 
@@ -148,35 +365,36 @@ GRAPH * g_from_stream(FILE *fp) {
 
 void g_free(GRAPH *g)
 {
-  int i;
-  for(i = 0; i<g->n; i++) {
-    LST_NODE *cur = g->vertices[i].neighbors;
-    while(cur != NULL) {
-      LST_NODE *tmp = cur->next;
-      free(cur);
-      cur = tmp;
-    }
-    if(g->vertices[i].name != NULL)
-      free(g->vertices[i].name);
+  adj_free(g);
+  if(g->idmap != NULL)
+    hmap_free(g->idmap, 0);
+  if(g->nameidx != NULL) {
+    mphf_free(g->nameidx);
+    free(g->mph2id);
   }
-  hmap_free(g->idmap, 0);
+  free(g->pool);
+  free(g->nameview);
+  free(g->ext2int);
+  free(g->int2ext);
+  free(g->coords);
   free(g->vertices);
+  pthread_mutex_destroy(&g->rev_lock);
   free(g);
 }
 
 
 
 void g_disp(GRAPH *g) {
-  int u;
-  LST_NODE *p;
+  int u, v;
+  weight_t w;
+  EDGE_IT it;
 
   printf("------------\n");
   for(u = 0; u < g->n; u++) {
     printf("%s : < ", g->vertices[u].name);
-    p = g->vertices[u].neighbors;
-    while(p != NULL) {
-      printf("%s %lf ", g->vertices[p->id].name, p->weight);
-      p = p->next;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      printf("%s %lf ", g->vertices[v].name, weight_to_double(w));
     }
     printf(">\n");
   }
@@ -190,8 +408,8 @@ char ** g_get_names(GRAPH *g) {
   n = g->n;
   char **ret = malloc(sizeof(char*)*n);
   for(i = 0; i < n; i++) {
-    if(g->vertices[i].name != NULL) {
-      ret[i] = strdup(g->vertices[i].name);
+    if(g->vertices[g_int_id(g, i)].name != NULL) {
+      ret[i] = strdup(g->vertices[g_int_id(g, i)].name);
     }
     else
       ret[i] = strdup(" ");
@@ -199,64 +417,225 @@ char ** g_get_names(GRAPH *g) {
   return ret;
 }
 
+const char ** g_get_names_v(GRAPH *g) {
+  int i;
+  if(g->nameview == NULL) {
+    g->nameview = malloc(sizeof(char*) * g->n);
+    for(i = 0; i < g->n; i++) {
+      const char *name = g->vertices[g_int_id(g, i)].name;
+      g->nameview[i] = name != NULL ? name : " ";
+    }
+  }
+  return g->nameview;
+}
+
+static unsigned long long mix64(unsigned long long h, unsigned long long x) {
+  h ^= x + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h;
+}
+
+unsigned long long g_version_hash(GRAPH *g) {
+  unsigned long long h, bits;
+  EDGE_IT it;
+  weight_t w;
+  double wd;
+  int u, v;
+
+  if(g->vhash_valid)
+    return g->vhash;
+  h = mix64(0, (unsigned long long)g->n);
+  if(g->directed)
+    h = mix64(h, 1);
+  for(u = 0; u < g->n; u++) {
+    h = mix64(h, g->vertices[u].name != NULL ?
+	      hmap_hash64(g->vertices[u].name, 0) : 0);
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      wd = weight_to_double(w);
+      memcpy(&bits, &wd, sizeof(bits));
+      h = mix64(mix64(h, (unsigned long long)v), bits);
+    }
+  }
+  g->vhash = h;
+  g->vhash_valid = 1;
+  return h;
+}
+
 PATH_RPT * create_dijk_rpt(GRAPH *g, int s, int n) {
   PATH_RPT *ret = malloc(sizeof(PATH_RPT));
   ret->g = g;
   ret->s = s;
-  ret->d = malloc(sizeof(double)*n);
+  ret->d = malloc(sizeof(dist_t)*n);
   ret->pred = malloc(sizeof(int)*n);
+  ret->stamp = NULL;
+  ret->epoch = 0;
+  ret->ctx_owned = 0;
+  ret->df = NULL;
+  ret->dd = NULL;
+  ret->map = NULL;
   return ret;
 }
 
+/*
+ * Dijkstra from s.  Vertices enter q when first reached, so the
+ *   work is proportional to the part of the graph explored.  v
+ *   counts as reached when stamp[v] == epoch or, without stamps,
+ *   when d[v] < DIST_INF (the caller then initializes d and pred).
+ *   Stops once t is settled if t >= 0.  Leaves q empty.
+ *   Follows in-edges, so on directed graphs d[v] is the distance
+ *   from v to s and pred[v] the next vertex on the way there.
+ */
+static void dijkstra(GRAPH *g, PQ *q, dist_t *d, int *pred,
+		     unsigned *stamp, unsigned epoch, int s, int t) {
+  int u, v;
+  dist_t du, dv;
+  weight_t w;
+  EDGE_IT it;
+
+  d[s] = 0;
+  pred[s] = s;
+  if(stamp != NULL)
+    stamp[s] = epoch;
+  pq_insert(q, s, 0);
+
+  while(pq_delete_top(q, &u, &du)) {
+    if(u == t)
+      break;
+    edge_begin_in(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      dv = dist_add(du, w);
+      if(stamp != NULL ? stamp[v] != epoch : d[v] == DIST_INF) {
+	if(stamp != NULL)
+	  stamp[v] = epoch;
+	d[v] = dv;
+	pred[v] = u;
+	pq_insert(q, v, dv);
+      }
+      else if(dv < d[v] && pq_contains(q, v)) {
+	d[v] = dv;
+	pred[v] = u;
+	pq_change_priority(q, v, dv);
+      }
+    }
+  }
+  pq_clear(q);
+}
+
 /* should return array that is shortest path from src to dest with the total dist*/
 PATH_RPT * g_shortest_path(GRAPH *g, char *src) {
   int u, v, n;
-  LST_NODE *p; 
   PATH_RPT *ret;  
-  PQ *q = pq_create(g->n, 1);
   n = g->n;
   u = getID(g, src);
   
   if(u == -1) {
     fprintf(stderr, "error: invalid src for shortest path\n");
-    pq_free(q);
     return NULL;
   }
   
-  ret = create_dijk_rpt(g, u, n);
+  if(g->chains != NULL)
+    return chains_shortest_path(g, u);
+  if(g->fringe != NULL)
+    return fringe_shortest_path(g, u);
+  adj_reverse(g);
 
+  ret = create_dijk_rpt(g, u, n);
   for(v = 0; v < n; v++) {
-    pq_insert(q, v, DBL_MAX);
+    ret->d[v] = DIST_INF;
     ret->pred[v] = -1;
   }
-  
-  ret->pred[u] = u;
-  pq_change_priority(q, u, 0.0);
-  double dist;
-
-  while(pq_size(q) > 0) {
-    pq_delete_top(q, &u, &dist);
-    ret->d[u] = dist;
-    p = g->vertices[u].neighbors;
-
-    while(p != NULL) {
-      v = p->id; 
-      if(pq_get_priority(q, v, &dist)) {
-	if(dist > ret->d[u] + p->weight) {
-	  pq_change_priority(q, v, (ret->d[u] + p->weight));
-	  ret->pred[v] = u;
-	}
-      }
-      p = p->next;
-    }
-  }
+
+  PQ *q = pq_create(n, 1);
+  dijkstra(g, q, ret->d, ret->pred, NULL, 0, u, -1);
   pq_free(q);
+  if(tile_failed(g)) {
+    rpt_free(ret);
+    return NULL;
+  }
   return ret;
 }
 
+struct query_ctx {
+  GRAPH *g;
+  PQ *q;
+  dist_t *d;
+  int *pred;
+  unsigned *stamp;
+  unsigned epoch;
+  PATH_RPT rpt;
+};
+
+QUERY_CTX * g_query_ctx_create(GRAPH *g) {
+  QUERY_CTX *ctx = malloc(sizeof(QUERY_CTX));
+  int n = g->n;
+
+  ctx->g = g;
+  ctx->q = pq_create(n, 1);
+  ctx->d = malloc(sizeof(dist_t) * n);
+  ctx->pred = malloc(sizeof(int) * n);
+  ctx->stamp = calloc(n, sizeof(unsigned));
+  ctx->epoch = 0;
+  ctx->rpt.g = g;
+  ctx->rpt.s = -1;
+  ctx->rpt.d = ctx->d;
+  ctx->rpt.pred = ctx->pred;
+  ctx->rpt.stamp = ctx->stamp;
+  ctx->rpt.epoch = 0;
+  ctx->rpt.ctx_owned = 1;
+  ctx->rpt.df = NULL;
+  ctx->rpt.dd = NULL;
+  ctx->rpt.map = NULL;
+  return ctx;
+}
+
+void g_query_ctx_free(QUERY_CTX *ctx) {
+  pq_free(ctx->q);
+  free(ctx->d);
+  free(ctx->pred);
+  free(ctx->stamp);
+  free(ctx);
+}
+
+PATH_RPT * g_shortest_path_ctx(QUERY_CTX *ctx, char *src, char *target) {
+  int s, t = -1;
+
+  s = getID(ctx->g, src);
+  if(s == -1) {
+    fprintf(stderr, "error: invalid src for shortest path\n");
+    return NULL;
+  }
+  if(target != NULL && (t = getID(ctx->g, target)) == -1) {
+    fprintf(stderr, "error: invalid target for shortest path\n");
+    return NULL;
+  }
+  adj_reverse(ctx->g);
+
+  // a new epoch invalidates every entry at once; clear on wrap-around
+  if(++ctx->epoch == 0) {
+    memset(ctx->stamp, 0, sizeof(unsigned) * ctx->g->n);
+    ctx->epoch = 1;
+  }
+  dijkstra(ctx->g, ctx->q, ctx->d, ctx->pred, ctx->stamp, ctx->epoch, s, t);
+  if(tile_failed(ctx->g))
+    return NULL;
+  ctx->rpt.s = s;
+  ctx->rpt.epoch = ctx->epoch;
+  return &ctx->rpt;
+}
+
 
 
 void rpt_free(PATH_RPT *r) {
+  if(r->ctx_owned)
+    return;
+  if(r->map != NULL) {   // from rpt_load
+    munmap(r->map, r->maplen);
+    free(r);
+    return;
+  }
   free(r->d);
   free(r->pred);
   free(r);
@@ -268,8 +647,9 @@ void rpt_free(PATH_RPT *r) {
  */
 
 char ** g_get_neighbors(GRAPH *g, char *src, double **weights, int *out_size) {
-  int srcid, n;
-  LST_NODE *p;
+  int srcid, n, v;
+  weight_t w;
+  EDGE_IT it;
   srcid = getID(g, src);
   if(srcid == -1) {
     fprintf(stderr, "error: invalid src name for get_neighbors\n");
@@ -285,14 +665,13 @@ char ** g_get_neighbors(GRAPH *g, char *src, double **weights, int *out_size) {
     return NULL;
   }
 
-  p = g->vertices[srcid].neighbors;
+  edge_begin(g, srcid, &it);
   char **ret = malloc(sizeof(char*)*n);
   (*weights) = malloc(sizeof(double)*n);
   int i = 0;
-  while(p != NULL && i < n) {
-    ret[i] = strdup(g->vertices[p->id].name);
-    (*weights)[i] = p->weight;
-    p = p->next;
+  while(i < n && edge_next(&it, &v, &w)) {
+    ret[i] = strdup(g->vertices[v].name);
+    (*weights)[i] = weight_to_double(w);
     i++;
   }
   if(i != n) {
@@ -310,27 +689,30 @@ char ** g_get_neighbors(GRAPH *g, char *src, double **weights, int *out_size) {
 
 
 
-static char ** rpt_path_r(PATH_RPT *r, int id, int i, int *out_size) {
-  char **ret; 
-  if(id == r->s || id == -1) {
-    if(i == 0)
-      return NULL;
-    (*out_size) = i;
-    ret = malloc(sizeof(char*) * (*out_size));
-    return ret;
+int g_get_neighbors_v(GRAPH *g, const char *src, const char **names,
+		      double *weights, int cap) {
+  int srcid, i, v;
+  weight_t w;
+  EDGE_IT it;
+  srcid = getID(g, (char*)src);
+  if(srcid == -1) {
+    fprintf(stderr, "error: invalid src name for get_neighbors\n");
+    return -1;
   }
-  ret = rpt_path_r(r, r->pred[id], i+1, out_size);
-  if(id >= 0 && r->pred[id] >= 0)
-    ret[i] = strdup(r->g->vertices[ r->pred[id] ].name);
-  else
-    ret[i] = NULL;
-  return ret;
+
+  edge_begin(g, srcid, &it);
+  for(i = 0; i < cap && edge_next(&it, &v, &w); i++) {
+    names[i] = g->vertices[v].name;
+    weights[i] = weight_to_double(w);
+  }
+  return g->vertices[srcid].out_degree;
 }
 
 
+
 char ** rpt_path(PATH_RPT *r, char *src, double *out_dist, int *out_size) {
-  int n, srcid;
-  double dist;
+  int srcid, id, i, n;
+  char **ret;
 
   srcid = getID(r->g, src);
   if(srcid == -1) {
@@ -340,9 +722,75 @@ char ** rpt_path(PATH_RPT *r, char *src, double *out_dist, int *out_size) {
     return NULL;
   }
   
-  *out_dist = r->d[srcid];
-  char **ret = rpt_path_r(r, srcid, 1, out_size);
-  if(ret != NULL) 
+  *out_dist = rpt_d(r, srcid);
+  n = rpt_path_ids(r, srcid, NULL, 0);
+  if(n == 0) {   // unreachable: src followed by a NULL
+    ret = malloc(sizeof(char*) * 2);
     ret[0] = strdup(r->g->vertices[srcid].name);
+    ret[1] = NULL;
+    *out_size = 2;
+    return ret;
+  }
+  ret = malloc(sizeof(char*) * n);
+  for(i = 0, id = srcid; i < n; i++, id = rpt_pred(r, id))
+    ret[i] = strdup(r->g->vertices[id].name);
+  *out_size = n;
   return ret;
 }
+
+int rpt_path_ids(PATH_RPT *r, int src, int *buf, int cap) {
+  int id, len;
+
+  if(src < 0 || src >= r->g->n)
+    return -1;
+  src = g_int_id(r->g, src);
+  if(rpt_pred(r, src) == -1)
+    return 0;
+  for(id = src, len = 0; ; id = rpt_pred(r, id)) {
+    if(len < cap)
+      buf[len] = g_ext_id(r->g, id);
+    len++;
+    if(id == r->s)
+      break;
+  }
+  return len;
+}
+
+int rpt_next_hop(PATH_RPT *r, int id) {
+  if(id < 0 || id >= r->g->n)
+    return -1;
+  id = g_int_id(r->g, id);
+  if(id == r->s)
+    return -1;
+  return g_ext_id(r->g, rpt_pred(r, id));
+}
+
+double rpt_dist(PATH_RPT *r, int id) {
+  if(id < 0 || id >= r->g->n)
+    return DBL_MAX;
+  return rpt_d(r, g_int_id(r->g, id));
+}
+
+int rpt_path_v(PATH_RPT *r, const char *src, double *out_dist,
+	       const char **buf, int cap) {
+  int srcid, id, len;
+
+  srcid = getID(r->g, (char*)src);
+  if(srcid == -1) {
+    fprintf(stderr, "error: invalid src name for rpt_path\n");
+    *out_dist = 0;
+    return -1;
+  }
+
+  *out_dist = rpt_d(r, srcid);
+  if(rpt_pred(r, srcid) == -1)
+    return 0;
+  for(id = srcid, len = 0; ; id = rpt_pred(r, id)) {
+    if(len < cap)
+      buf[len] = r->g->vertices[id].name;
+    len++;
+    if(id == r->s)
+      break;
+  }
+  return len;
+}
@@ -6,24 +6,245 @@ typedef struct graph GRAPH;
 
 typedef struct dijk_rpt PATH_RPT;
 
+typedef struct query_ctx QUERY_CTX;
+
+typedef struct overlay OVERLAY;
+
+typedef struct arcflags ARCFLAGS;
+
+/* header "n" for an undirected graph, "n directed" for one-way edges
+ * (src to dest only; memory for one edge per line instead of two) */
 extern GRAPH * g_from_stream(FILE *fp);
 
+/* same input, built in two passes straight into compact arrays
+ * (no per-edge allocation); fp must be seekable */
+extern GRAPH * g_from_stream_csr(FILE *fp);
+
+/* same graph as g_from_stream_csr, parsed by nthreads threads (<= 0:
+ * one per CPU); the file must have one edge per line */
+extern GRAPH * g_from_file_parallel(const char *path, int nthreads);
+
 extern void g_disp(GRAPH *g);
 
+/* name lookups (g_contains, g_vertex_id and the searches by name)
+ * only read the graph once it is loaded, so any number of threads
+ * may run them at once; the vertex set never changes after loading */
 extern int g_contains(GRAPH *g, char *name);
 
 extern void g_free(GRAPH *g);
 
 extern int g_size(GRAPH *g);
 
+extern int g_is_directed(GRAPH *g);
+
 extern char ** g_get_names(GRAPH *g);
 
+/* directed graphs: the tree of shortest paths *to* src, searched on
+ * the reverse edges, so rpt_dist and rpt_next_hop of v give the way
+ * from v to src as for undirected graphs.  The reverse edges are built
+ * by the first search that needs them (once, even if several threads
+ * start at the same time) and dropped when the edges change */
 extern PATH_RPT *  g_shortest_path(GRAPH *g, char *src);
 
+/* parallel delta-stepping; delta <= 0 and nthreads <= 0 pick defaults */
+extern PATH_RPT * g_shortest_path_delta(GRAPH *g, char *src, double delta, int nthreads);
+
+extern double g_auto_delta(GRAPH *g);
+
+/*
+ * Reusable query workspace: owns the queue and the per-vertex arrays,
+ *   so a query costs time proportional to the vertices it reaches
+ *   rather than to the graph.  One context per thread.
+ */
+extern QUERY_CTX * g_query_ctx_create(GRAPH *g);
+
+extern void g_query_ctx_free(QUERY_CTX *ctx);
+
+/* target NULL computes the whole tree; otherwise stops once target is
+ * settled and only paths to settled vertices are final.  The report
+ * belongs to ctx (rpt_free ignores it) and is valid until its next query */
+extern PATH_RPT * g_shortest_path_ctx(QUERY_CTX *ctx, char *src, char *target);
+
+/*
+ * Multilevel overlay (customizable route planning).  g_overlay_create
+ *   partitions g into cells of up to cell_size vertices, grouped into
+ *   nlevels levels of larger cells (<= 0: defaults); the partition
+ *   depends on the edges only.  Customizing computes, from the current
+ *   weights, the distances across each cell and must be repeated after
+ *   g_set_edge_weight (create does it once).  Queries are as
+ *   g_shortest_path_ctx with a target, but the report holds just the
+ *   path from target; it belongs to ov, valid until its next query.
+ *   Returns 0/NULL if g was renumbered (g_reorder) since create or
+ *   changed since the last customization.
+ */
+extern OVERLAY * g_overlay_create(GRAPH *g, int cell_size, int nlevels);
+
+extern int g_overlay_customize(OVERLAY *ov, int nthreads);
+
+extern PATH_RPT * g_shortest_path_overlay(OVERLAY *ov, char *src, char *target);
+
+extern void g_overlay_free(OVERLAY *ov);
+
+/*
+ * Arc flags.  g_arcflags_create cuts g into about nregions regions
+ *   (<= 0: a default) and flags each edge with the regions it leads
+ *   into on a shortest path: one full search per vertex on a region's
+ *   border, on nthreads threads (<= 0: one per CPU).  Queries are as
+ *   g_shortest_path_overlay but follow only the edges flagged for
+ *   src's region.  Flags hold for the weights and edge order they
+ *   were made with: queries return NULL once g has changed, and
+ *   g_arcflags_load refuses a file saved for another version of g
+ *   (see g_version_hash).  Save and load return 0/NULL on failure.
+ */
+extern ARCFLAGS * g_arcflags_create(GRAPH *g, int nregions, int nthreads);
+
+extern PATH_RPT * g_shortest_path_arcflags(ARCFLAGS *af, char *src, char *target);
+
+extern int g_arcflags_save(ARCFLAGS *af, const char *path);
+
+extern ARCFLAGS * g_arcflags_load(GRAPH *g, const char *path);
+
+extern void g_arcflags_free(ARCFLAGS *af);
+
+/* every edge src -> dest (and back if undirected) gets the weight;
+ * returns how many there were, -1 for an invalid name or adjacency
+ * that cannot be changed in place (tiled, fixed-point packed) */
+extern int g_set_edge_weight(GRAPH *g, char *src, char *dest, double weight);
+
 extern void rpt_free(PATH_RPT *r);
 
 extern char ** g_get_neighbors(GRAPH *g, char *src, double **weights, int *out_size);
 
 extern char ** rpt_path(PATH_RPT *r, char *src, double *out_dist, int *out_size);
 
+/*
+ * Allocation-free variants.  Returned names are views into the
+ *   graph's name pool: valid until g_free, never freed by the caller.
+ */
+
+/* NULL if id is out of range or the vertex has no name */
+extern const char * g_vertex_name(GRAPH *g, int id);
+
+/* -1 if there is no vertex with that name */
+extern int g_vertex_id(GRAPH *g, const char *name);
+
+/* g_size(g) names, " " for unnamed vertices; owned by the graph
+ * (and still valid after g_reorder) */
+extern const char ** g_get_names_v(GRAPH *g);
+
+/* fills up to cap neighbors; returns the out-degree, -1 for an invalid src */
+extern int g_get_neighbors_v(GRAPH *g, const char *src, const char **names,
+			     double *weights, int cap);
+
+/* fills up to cap names of the path src..r's source; returns its
+ * length, 0 if unreachable, -1 for an invalid src */
+extern int rpt_path_v(PATH_RPT *r, const char *src, double *out_dist,
+		      const char **buf, int cap);
+
+/*
+ * Renumbers the vertices internally so that neighbors sit close
+ *   together in memory.  Names and the ids seen through this
+ *   interface do not change; reports computed before are invalid.
+ *   HILBERT needs g_set_coords first.  Returns 0 on failure.
+ */
+#define G_ORDER_BFS 0
+#define G_ORDER_RCM 1
+#define G_ORDER_HILBERT 2
+
+extern int g_reorder(GRAPH *g, int method);
+
+/* x[id], y[id] for every vertex id; copied */
+extern void g_set_coords(GRAPH *g, double *x, double *y);
+
+/*
+ * Compressed adjacency: neighbor ids sorted and varint delta coded,
+ *   weights stored as float or as 16-bit fixed point relative to the
+ *   largest weight, all in one block.  Costs 3-7 bytes per edge
+ *   instead of a 32-byte list node.  Weights lose precision and
+ *   g_get_neighbors lists neighbors in id order.  Returns 0 for an
+ *   unknown format.
+ */
+#define G_WEIGHT_FLOAT 0
+#define G_WEIGHT_FIXED16 1
+
+extern int g_compress(GRAPH *g, int wfmt);
+
+/* bytes held by the adjacency (list nodes counted with malloc overhead) */
+extern unsigned long g_adj_bytes(GRAPH *g);
+
+/* keeps only the lightest of parallel edges (same endpoints); returns
+ * how many edges it removed.  Linear time; run it before querying */
+extern long g_collapse_multi_edges(GRAPH *g);
+
+/*
+ * Contracts chains of degree-2 vertices into single edges of a core
+ *   graph that g_shortest_path searches instead (reports still cover
+ *   every vertex).  Returns the number of vertices taken out of the
+ *   search, -1 for directed graphs.  Undone by anything that rebuilds
+ *   the adjacency (g_reorder, g_compress, g_collapse_multi_edges).
+ */
+extern int g_contract_chains(GRAPH *g);
+
+/*
+ * Peels the trees hanging off the graph (dead ends, leaves) so that
+ *   g_shortest_path searches only the 2-core and reaches tree vertices
+ *   through their parent pointers.  Returns the number of vertices
+ *   peeled, -1 for directed graphs.  Replaces g_contract_chains (and
+ *   vice versa); undone like it.
+ */
+extern int g_peel_fringe(GRAPH *g);
+
+/*
+ * Out-of-core graphs.  g_write_tiles stores g in one file, cut into
+ *   tiles of tile_size consecutive vertices (<= 0: a default; reorder
+ *   first so that neighbors share tiles).  g_open_tiled loads only the
+ *   names and degrees; searches read the edges tile by tile as they
+ *   reach them, keeping the cache_tiles most recently used (<= 0: a
+ *   default).  Directed graphs also get tiles of their in-edges, so
+ *   their searches do not build the reverse edges in memory.
+ *   g_open_tiled fails on a file whose degrees do not match its tiles
+ *   or whose ids are not a permutation.  Ids and g_version_hash are
+ *   those of the written graph.
+ *   Rebuilding the adjacency (g_compress, g_reorder, ...) pulls the
+ *   whole graph into memory.  g_tile_stats counts the tile lookups
+ *   served from the cache and those that read the file.  If a tile
+ *   cannot be read (the file changed or went away), the call that
+ *   needed it fails: searches and g_overlay_create/g_arcflags_create
+ *   return NULL, g_reorder, g_compress and g_overlay_customize 0,
+ *   g_collapse_multi_edges, g_contract_chains and g_peel_fringe -1.
+ */
+extern int g_write_tiles(GRAPH *g, const char *path, int tile_size);
+
+extern GRAPH * g_open_tiled(const char *path, int cache_tiles);
+
+extern void g_tile_stats(GRAPH *g, long *hits, long *misses);
+
+/*
+ * Persisted reports.  The file stores d (as float if use_float) and
+ *   pred for every vertex, tagged with g_version_hash of the graph;
+ *   rpt_load maps it read-only and refuses files made for another
+ *   graph.  Both return NULL/0 on failure.
+ */
+extern int rpt_save(PATH_RPT *r, const char *path, int use_float);
+
+extern PATH_RPT * rpt_load(GRAPH *g, const char *path);
+
+/* hash of the vertex names and weighted adjacency */
+extern unsigned long long g_version_hash(GRAPH *g);
+
+/*
+ * Id-based path queries; constant time per hop and no recursion.
+ *   The path from src ends at the source r was computed from.
+ */
+
+/* writes up to cap ids of the path from src; returns its length,
+ * 0 if unreachable, -1 for an invalid id.  buf may be NULL if cap is 0 */
+extern int rpt_path_ids(PATH_RPT *r, int src, int *buf, int cap);
+
+/* next vertex from id toward r's source; -1 at the source or if unreachable */
+extern int rpt_next_hop(PATH_RPT *r, int id);
+
+/* DBL_MAX if unreachable */
+extern double rpt_dist(PATH_RPT *r, int id);
+
 #endif
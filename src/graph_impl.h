@@ -0,0 +1,399 @@
+#ifndef GRAPH_IMPL_H
+#define GRAPH_IMPL_H
+
+/**
+ * Internal representation of GRAPH and PATH_RPT, shared by the
+ *   modules that implement graph algorithms (graph.c, dstep.c, ...).
+ *
+ * Clients should only include graph.h.  Includers must include
+ *   hmap.h, mphf.h and graph.h first.
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * Weight precision, fixed at build time (make WEIGHT=float|uint):
+ *   weight_t holds edge weights, dist_t path lengths (which are also
+ *   the PQ priorities, see PQ_PRIORITY_T).  uint stores weights in
+ *   units of 1/WEIGHT_SCALE, rounded up to at least 1, and sums
+ *   saturate at DIST_INF.  Everything in graph.h stays double.
+ */
+#if defined(WEIGHT_FLOAT)
+typedef float weight_t;
+typedef float dist_t;
+#define DIST_INF FLT_MAX
+#define WEIGHT_UNIT 1.0
+#elif defined(WEIGHT_UINT)
+#ifndef WEIGHT_SCALE
+#define WEIGHT_SCALE 1000
+#endif
+typedef unsigned weight_t;
+typedef unsigned dist_t;
+#define DIST_INF UINT_MAX
+#define WEIGHT_UNIT ((double)WEIGHT_SCALE)
+#else
+typedef double weight_t;
+typedef double dist_t;
+#define DIST_INF DBL_MAX
+#define WEIGHT_UNIT 1.0
+#endif
+
+static inline dist_t dist_add(dist_t d, weight_t w) {
+#ifdef WEIGHT_UINT
+  return d >= DIST_INF - w ? DIST_INF : d + w;
+#else
+  return d + w;
+#endif
+}
+
+static inline weight_t weight_from_double(double w) {
+#ifdef WEIGHT_UINT
+  double q = w * WEIGHT_SCALE + 0.5;
+  return q < 1 ? 1 : q >= UINT_MAX ? UINT_MAX - 1 : (weight_t)q;
+#else
+  return (weight_t)w;
+#endif
+}
+
+static inline double weight_to_double(weight_t w) {
+  return w / WEIGHT_UNIT;
+}
+
+/* DIST_INF (unreached) becomes DBL_MAX */
+static inline double dist_to_double(dist_t d) {
+  return d == DIST_INF ? DBL_MAX : d / WEIGHT_UNIT;
+}
+
+typedef struct lst_node {
+  int id;
+  weight_t weight;
+  struct lst_node *next;
+} LST_NODE;
+
+typedef struct vertex_t {
+  char *name;         // points into the graph's name pool
+  int id;
+  int out_degree;
+  LST_NODE *neighbors;
+} VERTEX;
+
+/*
+ * Adjacency storage.  ADJ_LIST is what g_from_stream builds;
+ *   g_from_stream_csr builds ADJ_CSR: the edges of vertex u are
+ *   csr_adj/csr_w[csr_off[u] .. csr_off[u+1]-1].  g_compress
+ *   switches to ADJ_PACKED: per vertex, its edges sorted by neighbor
+ *   id, each a LEB128 varint of the id delta to the previous edge
+ *   followed by the weight (4-byte float or 2-byte fixed point).
+ *   g_open_tiled gives ADJ_TILED: CSR pieces per tile of vertices,
+ *   read from the file through a small cache (tiles.c) as edge_begin
+ *   asks for them.  Traversals go through EDGE_IT so they work with
+ *   any of them.
+ */
+#define ADJ_LIST 0
+#define ADJ_PACKED 1
+#define ADJ_CSR 2
+#define ADJ_TILED 3
+
+typedef struct tile_store TILE_STORE;
+
+typedef struct {
+  unsigned char *bytes;
+  size_t *off;          // n+1 offsets into bytes
+  int wfmt;             // G_WEIGHT_FLOAT or G_WEIGHT_FIXED16
+  double wscale;        // fixed point: weight = q * wscale
+  weight_t wstep;       //   the same in weight_t, which decoding uses
+} PACKED_ADJ;
+
+/* one edge, for (re)building adjacency; w as in graph.h */
+typedef struct {
+  int v;
+  double w;
+} EDGE_REC;
+
+typedef struct chains CHAINS;
+typedef struct fringe FRINGE;
+
+struct dijk_rpt {
+  GRAPH *g;
+  int s;
+  dist_t *d;
+  int *pred;
+  unsigned *stamp;    // QUERY_CTX reports: entry v is valid iff
+  unsigned epoch;     //   stamp[v] == epoch; NULL otherwise
+  int ctx_owned;      // rpt_free leaves it alone
+  float *df;          // rpt_load: d lives in the mapping instead, as
+  double *dd;         //   float or double
+  void *map;          // rpt_load: mapping that holds pred, df/dd
+  size_t maplen;
+};
+
+/* d and pred of v; entries a query did not reach read as unreached */
+static inline double rpt_d(PATH_RPT *r, int v) {
+  if(r->map != NULL) {
+    if(r->df != NULL)   // unreached is stored as +inf
+      return r->df[v] <= FLT_MAX ? r->df[v] : DBL_MAX;
+    return r->dd[v];
+  }
+  return r->stamp == NULL || r->stamp[v] == r->epoch ?
+    dist_to_double(r->d[v]) : DBL_MAX;
+}
+
+static inline int rpt_pred(PATH_RPT *r, int v) {
+  return r->stamp == NULL || r->stamp[v] == r->epoch ? r->pred[v] : -1;
+}
+
+struct graph {
+  int n;              // Size of graph
+  VERTEX *vertices;   // Array of vertices
+  HMAP_PTR idmap;     // name -> id while loading; NULL afterwards
+  MPHF *nameidx;      // name -> slot of mph2id once loaded
+  int *mph2id;
+  char *pool;         // all names, '\0'-separated, in id order
+  size_t pool_len;
+  size_t pool_cap;
+  const char **nameview;  // built by g_get_names_v on first use
+  unsigned long long vhash;  // g_version_hash, once computed
+  int vhash_valid;
+  int *ext2int;       // set by g_reorder: ids seen by clients <->
+  int *int2ext;       //   indices into vertices[]; NULL = identity
+  double *coords;     // x,y per vertex (by index) if g_set_coords
+  int adj_mode;       // ADJ_LIST, ADJ_PACKED or ADJ_CSR
+  PACKED_ADJ *pk;     // ADJ_PACKED only
+  long *csr_off;      // ADJ_CSR only
+  int *csr_adj;
+  weight_t *csr_w;
+  int directed;       // edges one-way; adjacency holds out-edges only
+  long *rev_off;      // directed: in-edges as CSR, built by adj_reverse
+  int *rev_adj;       //   on first use; NULL until then
+  weight_t *rev_w;
+  pthread_mutex_t rev_lock;  // one thread builds rev_*, the rest wait
+  CHAINS *chains;     // set by g_contract_chains; NULL otherwise
+  FRINGE *fringe;     // set by g_peel_fringe; NULL otherwise
+  TILE_STORE *tiles;  // ADJ_TILED only
+  unsigned long edge_gen;  // bumped whenever edges or weights change
+  unsigned long id_gen;    // bumped whenever g_reorder renumbers
+};
+
+typedef struct {
+  int mode;
+  LST_NODE *p;             // ADJ_LIST
+  const int *a;            // ADJ_CSR
+  const weight_t *wa;
+  long i;
+  long end;
+  const unsigned char *b;  // ADJ_PACKED
+  int left;
+  int prev;
+  int wfmt;
+  weight_t wstep;
+} EDGE_IT;
+
+/*
+ * edges of u (in-edges if in is set) from its tile, reading the tile
+ *   in if it is not cached; valid until the next call (which may
+ *   evict the tile)
+ */
+extern void tile_edges(GRAPH *g, int u, int in, const int **adj,
+		       const weight_t **w, long *i, long *end);
+
+/*
+ * nonzero if a tile could not be read (tile_edges then gave u no
+ *   edges) since the last call, which clears it; 0 if g is not tiled.
+ *   Public functions that read the edges check it and fail.
+ */
+extern int tile_failed(GRAPH *g);
+
+static inline void edge_begin(GRAPH *g, int u, EDGE_IT *it) {
+  it->mode = g->adj_mode;
+  if(it->mode == ADJ_TILED) {
+    it->mode = ADJ_CSR;
+    tile_edges(g, u, 0, &it->a, &it->wa, &it->i, &it->end);
+    return;
+  }
+  if(it->mode == ADJ_LIST) {
+    it->p = g->vertices[u].neighbors;
+    return;
+  }
+  if(it->mode == ADJ_CSR) {
+    it->a = g->csr_adj;
+    it->wa = g->csr_w;
+    it->i = g->csr_off[u];
+    it->end = g->csr_off[u+1];
+    return;
+  }
+  it->b = g->pk->bytes + g->pk->off[u];
+  it->left = g->vertices[u].out_degree;
+  it->prev = 0;
+  it->wfmt = g->pk->wfmt;
+  it->wstep = g->pk->wstep;
+}
+
+/* next out-edge (u, *v) of weight *w; 0 when there are no more */
+static inline int edge_next(EDGE_IT *it, int *v, weight_t *w) {
+  unsigned x, c;
+  int sh;
+
+  if(it->mode == ADJ_LIST) {
+    if(it->p == NULL)
+      return 0;
+    *v = it->p->id;
+    *w = it->p->weight;
+    it->p = it->p->next;
+    return 1;
+  }
+  if(it->mode == ADJ_CSR) {
+    if(it->i == it->end)
+      return 0;
+    *v = it->a[it->i];
+    *w = it->wa[it->i++];
+    return 1;
+  }
+  if(it->left == 0)
+    return 0;
+  it->left--;
+  x = *it->b++;
+  if(x & 0x80) {
+    x &= 0x7f;
+    sh = 7;
+    do {
+      c = *it->b++;
+      x |= (c & 0x7f) << sh;
+      sh += 7;
+    } while(c & 0x80);
+  }
+  it->prev += x;
+  *v = it->prev;
+  if(it->wfmt == G_WEIGHT_FLOAT) {
+    float f;
+    memcpy(&f, it->b, sizeof(f));
+    it->b += sizeof(f);
+    *w = weight_from_double(f);
+  }
+  else {
+    unsigned short q;
+    memcpy(&q, it->b, sizeof(q));
+    it->b += sizeof(q);
+    *w = q * it->wstep;
+  }
+  return 1;
+}
+
+/*
+ * in-edges (*v, u) of u; the same as its out-edges unless the graph
+ *   is directed, where they come from the reverse adjacency (so call
+ *   adj_reverse first) or, if tiled, from the reverse tiles
+ */
+static inline void edge_begin_in(GRAPH *g, int u, EDGE_IT *it) {
+  if(!g->directed) {
+    edge_begin(g, u, it);
+    return;
+  }
+  it->mode = ADJ_CSR;
+  if(g->adj_mode == ADJ_TILED) {   // reverse tiles from the file
+    tile_edges(g, u, 1, &it->a, &it->wa, &it->i, &it->end);
+    return;
+  }
+  it->a = g->rev_adj;
+  it->wa = g->rev_w;
+  it->i = g->rev_off[u];
+  it->end = g->rev_off[u+1];
+}
+
+/* client id <-> index into vertices[]; -1 maps to -1 */
+static inline int g_int_id(GRAPH *g, int ext) {
+  return g->ext2int == NULL || ext < 0 ? ext : g->ext2int[ext];
+}
+
+static inline int g_ext_id(GRAPH *g, int v) {
+  return g->int2ext == NULL || v < 0 ? v : g->int2ext[v];
+}
+
+/*
+ * All edges, grouped by tail: those of vertex order[k] (or k if order
+ *   is NULL) at [start[k], start[k+1]), heads mapped through newid
+ *   if given.  Caller frees both arrays.  NULL (nothing to free) if
+ *   a tile could not be read.
+ */
+extern EDGE_REC * adj_flatten(GRAPH *g, int *order, int *newid, long **start);
+
+/*
+ * Replaces the adjacency of g by the packed encoding of e/start (as
+ *   from adj_flatten, in the current vertex order).  Sorts each
+ *   vertex's edges.
+ */
+extern void adj_pack(GRAPH *g, EDGE_REC *e, long *start, int wfmt);
+
+/* same for ADJ_CSR, keeping each vertex's edge order */
+extern void adj_csr(GRAPH *g, EDGE_REC *e, long *start);
+
+/* frees the adjacency in whatever mode it is stored, with its reverse */
+extern void adj_free(GRAPH *g);
+
+/*
+ * Builds the reverse adjacency of a directed graph if it is not there
+ *   yet; no-op for undirected and tiled graphs (which read their
+ *   reverse tiles instead).  Every entry point that reaches
+ *   edge_begin_in calls it first; queries running at the same time
+ *   build it once between them.
+ */
+extern void adj_reverse(GRAPH *g);
+
+/*
+ * Drops what was computed from the adjacency after the edges changed:
+ *   the core of g_contract_chains or g_peel_fringe (queries fall back
+ *   to the full graph) and the reverse edges, rebuilt on next use.
+ */
+extern void adj_drop_derived(GRAPH *g);
+
+/* chain contraction state, see simplify.c */
+extern void chains_free(CHAINS *c);
+
+/* closes the file of an ADJ_TILED graph and frees its cache */
+extern void tile_close(TILE_STORE *ts);
+
+/* bytes of it held in memory */
+extern unsigned long tile_bytes(TILE_STORE *ts);
+
+/* g_shortest_path from s on the contracted core of g */
+extern PATH_RPT * chains_shortest_path(GRAPH *g, int s);
+
+/* the same for g_peel_fringe */
+extern void fringe_free(FRINGE *f);
+
+extern PATH_RPT * fringe_shortest_path(GRAPH *g, int s);
+
+/*
+ * Nested partition of the vertices (partition.c): cell[l][v] is the
+ *   cell of v at level l, in [0, ncells[l]).  Each level-l cell holds
+ *   at most maxsize[l] vertices and lies inside one level l+1 cell.
+ *   Built from the edges only, never from their weights.
+ */
+typedef struct {
+  int nlevels;
+  int *ncells;
+  int **cell;
+} PARTITION;
+
+extern PARTITION * part_build(GRAPH *g, int nlevels, const long *maxsize);
+
+extern void part_free(PARTITION *p);
+
+/* empty graph of n vertices; with_idmap for loading through getNextID */
+extern GRAPH * g_new(int n, int with_idmap);
+
+/* copies name into the pool as the name of vertex id (ids ascending) */
+extern void g_intern_name(GRAPH *g, int id, char *name);
+
+/* ends loading: indexes the names with the MPHF, drops idmap and
+ * builds the reverse edges of a directed graph */
+extern void g_freeze_names(GRAPH *g);
+
+extern PATH_RPT * create_dijk_rpt(GRAPH *g, int s, int n);
+
+/* id of the vertex with the given name; -1 if there is none */
+extern int g_lookup_id(GRAPH *g, char *name);
+
+#endif
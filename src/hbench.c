@@ -0,0 +1,199 @@
+/**
+ * Hash function selection benchmark for hmap.
+ *
+ * usage:  hbench [graph_file ...]
+ *
+ * Collects the vertex names of the given graph files plus three 
+ *   synthetic corpora: two shaped like our data (three-letter city 
+ *   codes and "loc" + suffix names) and 200k random names (letters 
+ *   and digits, 4 to 16 long, from a fixed seed so runs repeat).
+ *   For each built-in hash function, reports hashing speed, full 
+ *   32-bit collisions and the time to load and query an hmap 
+ *   holding the corpus.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hmap.h"
+
+#define NUM_HFUNCS 4
+#define REPS 20
+
+typedef struct {
+  char *desc;
+  char **names;
+  int n;
+  int cap;
+} CORPUS;
+
+static void add_name(CORPUS *c, char *name) {
+  if(c->n == c->cap) {
+    c->cap = c->cap == 0 ? 1024 : 2*c->cap;
+    c->names = realloc(c->names, c->cap*sizeof(char*));
+  }
+  c->names[c->n++] = strdup(name);
+}
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/* distinct names of a graph file (see g_from_stream for the format) */
+static void load_names(CORPUS *c, char *fname) {
+  HMAP_PTR seen = hmap_create(0, 0);
+  char src[128], dest[128];
+  double w;
+  int n;
+  FILE *fp = fopen(fname, "r");
+
+  if(fp == NULL || fscanf(fp, "%i", &n) != 1) {
+    fprintf(stderr, "hbench: cannot read %s\n", fname);
+    if(fp != NULL)
+      fclose(fp);
+    hmap_free(seen, 0);
+    return;
+  }
+  while(fscanf(fp, "%127s %127s %lf", src, dest, &w) == 3) {
+    if(!hmap_contains(seen, src)) {
+      hmap_set(seen, src, NULL);
+      add_name(c, src);
+    }
+    if(!hmap_contains(seen, dest)) {
+      hmap_set(seen, dest, NULL);
+      add_name(c, dest);
+    }
+  }
+  fclose(fp);
+  hmap_free(seen, 0);
+}
+
+static void city_codes(CORPUS *c) {
+  char buf[4];
+  int a, b, d;
+
+  for(a = 0; a < 26; a++)
+    for(b = 0; b < 26; b++)
+      for(d = 0; d < 26; d++) {
+	sprintf(buf, "%c%c%c", 'A'+a, 'a'+b, 'a'+d);
+	add_name(c, buf);
+      }
+}
+
+static void loc_names(CORPUS *c, int n) {
+  char buf[16];
+  int i, j, k;
+
+  for(i = 0; i < n; i++) {
+    strcpy(buf, "loc");
+    for(j = i, k = 3; k == 3 || j > 0; j /= 26, k++)
+      buf[k] = 'A' + j % 26;
+    buf[k] = '\0';
+    add_name(c, buf);
+  }
+}
+
+/* n distinct random names; srand'd by the caller */
+static void random_names(CORPUS *c, int n) {
+  static const char chars[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  HMAP_PTR seen = hmap_create(0, 0);
+  char buf[17];
+  int len, k;
+
+  while(c->n < n) {
+    len = 4 + rand() % 13;
+    for(k = 0; k < len; k++)
+      buf[k] = chars[rand() % (sizeof(chars) - 1)];
+    buf[len] = '\0';
+    if(!hmap_contains(seen, buf)) {
+      hmap_set(seen, buf, NULL);
+      add_name(c, buf);
+    }
+  }
+  hmap_free(seen, 0);
+}
+
+static int cmp_unsigned(const void *a, const void *b) {
+  unsigned x = *(unsigned *)a, y = *(unsigned *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void bench(CORPUS *c) {
+  unsigned *hv = malloc(c->n*sizeof(unsigned));
+  int id, i, r, coll;
+  volatile unsigned sink = 0;
+
+  printf("%s: %i names\n", c->desc, c->n);
+  printf("  %-40s %9s %10s %10s\n", "hash function", "ns/hash", "collisions",
+	 "ns/lookup");
+  for(id = 0; id < NUM_HFUNCS; id++) {
+    HMAP_PTR map = hmap_create(0, 0);
+    double t0, th, tl;
+    char *desc;
+
+    hmap_set_hfunc(map, id);
+    desc = hmap_hfunc_desc(map);
+    for(i = 0; i < c->n; i++)
+      hmap_set(map, c->names[i], c->names[i]);
+
+    t0 = now();
+    for(r = 0; r < REPS; r++)
+      for(i = 0; i < c->n; i++)
+	sink += hmap_hash(map, c->names[i]);
+    th = (now() - t0) / ((double)REPS * c->n);
+
+    for(i = 0; i < c->n; i++)
+      hv[i] = hmap_hash(map, c->names[i]);
+    qsort(hv, c->n, sizeof(unsigned), cmp_unsigned);
+    for(coll = 0, i = 1; i < c->n; i++)
+      coll += (hv[i] == hv[i-1]);
+
+    t0 = now();
+    for(r = 0; r < REPS; r++)
+      for(i = 0; i < c->n; i++)
+	sink += (hmap_get(map, c->names[i]) != NULL);
+    tl = (now() - t0) / ((double)REPS * c->n);
+
+    printf("  %-40s %9.1f %10i %10.1f\n", desc, th*1e9, coll, tl*1e9);
+    hmap_free(map, 0);
+  }
+  printf("\n");
+  free(hv);
+}
+
+static void corpus_free(CORPUS *c) {
+  int i;
+  for(i = 0; i < c->n; i++)
+    free(c->names[i]);
+  free(c->names);
+}
+
+int main(int argc, char *argv[]) {
+  CORPUS files = {"graph files", NULL, 0, 0};
+  CORPUS codes = {"three-letter codes", NULL, 0, 0};
+  CORPUS locs = {"loc names", NULL, 0, 0};
+  CORPUS rnd = {"random names", NULL, 0, 0};
+  int i;
+
+  for(i = 1; i < argc; i++)
+    load_names(&files, argv[i]);
+  city_codes(&codes);
+  loc_names(&locs, 200000);
+  srand(1);
+  random_names(&rnd, 200000);
+
+  if(files.n > 0)
+    bench(&files);
+  bench(&codes);
+  bench(&locs);
+  bench(&rnd);
+
+  corpus_free(&files);
+  corpus_free(&codes);
+  corpus_free(&locs);
+  corpus_free(&rnd);
+  return 0;
+}
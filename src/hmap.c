@@ -1,37 +1,109 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "hmap.h"
 
 #define BASE1 27
 
+#define MIN_TSIZE 8
+#define MAX_LFACTOR (0.95)
+#define MIGRATE_STEP 4  // old home slots moved per write in incremental mode
+
+#define INLINE_KEY_LEN 16  // keys shorter than this are stored in the slot
+#define KEY_EXT 1          // tag byte of a slot whose key is out of line
+
+#define FIB_MULT 2654435769u   // 2^32 / golden ratio
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+
+#define XX_P1 2654435761u
+#define XX_P2 2246822519u
+#define XX_P3 3266489917u
+#define XX_P4 668265263u
+#define XX_P5 374761393u
+
 
 /******** STRUCTS AND TYPEDEFS *********/
 
-typedef struct node_struct {
-  struct node_struct *next;
-  char *key;
+typedef unsigned (*SHFUNC)(char *, unsigned long long);
+
+/**
+ * Keys of up to 15 characters (all vertex names) are stored in
+ *   the slot itself, zero padded to 16 bytes, so comparing one is
+ *   a single 16-byte compare with no pointer to chase.  Longer 
+ *   keys are copied out of line and the last byte of the key 
+ *   field is set to KEY_EXT, which no inline key can have.
+ */
+typedef union {
+  char inl[INLINE_KEY_LEN];
+  struct {
+    char *ptr;
+    char pad[INLINE_KEY_LEN - sizeof(char *) - 1];
+    char tag;     // KEY_EXT
+  } ext;
+} KEY;
+
+/**
+ * The table is open-addressed with Robin Hood probing: all
+ *   entries live in one flat array of 32-byte slots, and an entry
+ *   is never further from its home slot than the entries it was
+ *   allowed to pass on insertion.  Lookups stop as soon as they
+ *   meet a slot closer to its home than the probe so far.
+ */
+typedef struct {
+  KEY key;
   void *val;
   unsigned hval;
-}NODE;
+  unsigned psl;   // probe sequence length: 1 + distance from home
+                  //   slot; 0 marks an empty slot
+} SLOT;
 
+/* a key being looked up, in the form slots store it */
 typedef struct {
-  NODE *members;
-  int n;
-} TBL_ENTRY;
+  char *s;
+  size_t len;
+  KEY k;          // zero padded copy if len < INLINE_KEY_LEN
+} KEYREF;
 
+typedef struct {
+  SLOT *slots;    // NULL if the table is not in use
+  int tsize;      // always a power of two
+  int shift;      // 32 - log2(tsize), for home slot computation
+} TABLE;
+
+/**
+ * In incremental resize mode a resize only allocates the new
+ *   table; the entries of the old one are moved over a few home
+ *   slots at a time by later writes.  Entries whose old home slot
+ *   is below mig have been moved, so lookups only have to visit
+ *   the old table for keys homed at or after mig.
+ */
 struct hmap {
-  TBL_ENTRY *tbl;
-  int tsize;
-  int n; 
+  TABLE tbl;
+  TABLE old;      // table being drained (incremental mode only)
+  int mig;        // next home slot of old to migrate
+  int mig_step;   // home slots migrated per write
+  int incremental;
+  int n;
   double lfactor;
   int max_n;
+  int resize_count;
+  unsigned long key_bytes;  // total size of the key copies
   HFUNC hfunc;
+  SHFUNC shfunc;  // seeded form of hfunc; NULL if it has none
+  unsigned long long seed;
   char *hfunc_desc;
 };
 
 typedef struct {
   HFUNC hfunc;
+  SHFUNC shfunc;
   char *description;
 } HFUNC_STRUCT;
 
@@ -59,15 +131,128 @@ static unsigned h1(char *s) {
   }
   return h;
 }
+
+/*
+ * The word-at-a-time functions below read the key 8 (wyhash) or 4
+ *   (xxhash) bytes per step; loads go through memcpy so unaligned
+ *   keys are fine.
+ */
+static unsigned long long read64(const unsigned char *p) {
+  unsigned long long v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static unsigned read32(const unsigned char *p) {
+  unsigned v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static unsigned long long wymix(unsigned long long a, unsigned long long b) {
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return (unsigned long long)r ^ (unsigned long long)(r >> 64);
+}
+
+static unsigned long long wyhash64(char *key, size_t len,
+				   unsigned long long seed) {
+  const unsigned char *p = (const unsigned char *)key;
+  unsigned long long a, b;
+  size_t left = len;
+
+  seed ^= WY_P0;
+  while(left > 16) {
+    seed = wymix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+    p += 16;
+    left -= 16;
+  }
+  if(left >= 8) {
+    a = read64(p);
+    b = read64(p + left - 8);
+  }
+  else if(left >= 4) {
+    a = read32(p);
+    b = read32(p + left - 4);
+  }
+  else if(left > 0) {
+    a = ((unsigned long long)p[0] << 16) | ((unsigned long long)p[left/2] << 8)
+      | p[left - 1];
+    b = 0;
+  }
+  else
+    a = b = 0;
+  return wymix(WY_P2 ^ len, wymix(a ^ WY_P1, b ^ seed));
+}
+
+static unsigned rotl32(unsigned x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+static unsigned xxhash32(char *key, size_t len, unsigned seed) {
+  const unsigned char *p = (const unsigned char *)key;
+  const unsigned char *end = p + len;
+  unsigned h, v1, v2, v3, v4;
+
+  if(len >= 16) {
+    v1 = seed + XX_P1 + XX_P2;
+    v2 = seed + XX_P2;
+    v3 = seed;
+    v4 = seed - XX_P1;
+    while(end - p >= 16) {
+      v1 = rotl32(v1 + read32(p) * XX_P2, 13) * XX_P1;
+      v2 = rotl32(v2 + read32(p + 4) * XX_P2, 13) * XX_P1;
+      v3 = rotl32(v3 + read32(p + 8) * XX_P2, 13) * XX_P1;
+      v4 = rotl32(v4 + read32(p + 12) * XX_P2, 13) * XX_P1;
+      p += 16;
+    }
+    h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+  }
+  else
+    h = seed + XX_P5;
+  h += (unsigned)len;
+  while(end - p >= 4) {
+    h = rotl32(h + read32(p) * XX_P3, 17) * XX_P4;
+    p += 4;
+  }
+  while(p < end) {
+    h = rotl32(h + (*p) * XX_P5, 11) * XX_P1;
+    p++;
+  }
+  h ^= h >> 15;
+  h *= XX_P2;
+  h ^= h >> 13;
+  h *= XX_P3;
+  h ^= h >> 16;
+  return h;
+}
+
+static unsigned h2_seeded(char *s, unsigned long long seed) {
+  unsigned long long h = wyhash64(s, strlen(s), seed);
+  return (unsigned)(h ^ (h >> 32));
+}
+
+static unsigned h2(char *s) {
+  return h2_seeded(s, 0);
+}
+
+static unsigned h3_seeded(char *s, unsigned long long seed) {
+  return xxhash32(s, strlen(s), (unsigned)(seed ^ (seed >> 32)));
+}
+
+static unsigned h3(char *s) {
+  return h3_seeded(s, 0);
+}
 /******** END LIBRARY SUPPLIED HASH FUNCTIONS *****/
 
 
 
 /***** TWO GLOBALS TO THIS FILE ******/
-static HFUNC_STRUCT HashFunctions[] = 
-  { 
-    {h0, "naive char sum"},
-    {h1, "weighted char sum"}
+static HFUNC_STRUCT HashFunctions[] =
+  {
+    {h0, NULL, "naive char sum"},
+    {h1, NULL, "weighted char sum"},
+    {h2, h2_seeded, "wyhash-style 64-bit word-at-a-time"},
+    {h3, h3_seeded, "xxhash32-style 32-bit word-at-a-time"}
   };
 
 
@@ -76,12 +261,17 @@ static int NumHFuncs = sizeof(HashFunctions)/sizeof(HFUNC_STRUCT);
 /***** END GLOBALS ******/
 
 /***** FORWARD DECLARATIONS *****/
-static int match(char *key, unsigned hval, NODE *p); 
-static NODE **get_node_pred(HMAP_PTR map, char *key); 
-static TBL_ENTRY *create_tbl_array(int tsize); 
-static void resize(HMAP_PTR map); 
-static void free_lst(NODE *l, int free_vals); 
-static void add_front(TBL_ENTRY *entry, NODE *p);
+static unsigned hash_key(HMAP_PTR map, char *key);
+static void make_ref(KEYREF *r, char *key);
+static int match(KEYREF *r, unsigned hval, SLOT *p);
+static void free_key(HMAP_PTR map, SLOT *p);
+static SLOT *find_slot(HMAP_PTR map, KEYREF *r, unsigned h, TABLE **where);
+static SLOT *find_in(TABLE *t, KEYREF *r, unsigned h);
+static void create_tbl(HMAP_PTR map, TABLE *t, int tsize);
+static void resize(HMAP_PTR map);
+static void migrate(HMAP_PTR map, int nslots);
+static SLOT *rh_insert(TABLE *t, SLOT entry);
+static void rh_delete(TABLE *t, SLOT *p);
 /***** END FORWARD DECLARATIONS *****/
 
 
@@ -89,22 +279,38 @@ static void add_front(TBL_ENTRY *entry, NODE *p);
 
 HMAP_PTR hmap_create(unsigned init_tsize, double lfactor){
   HMAP_PTR map = malloc(sizeof(struct hmap));
+  unsigned tsize;
 
   map->n = 0;
+  map->old.slots = NULL;
+  map->incremental = 0;
+  map->resize_count = 0;
+  map->key_bytes = 0;
   if(lfactor <= 0)
     lfactor = DEFAULT_LFACTOR;
+  if(lfactor > MAX_LFACTOR)
+    lfactor = MAX_LFACTOR;
   if(init_tsize <= 0)
     init_tsize = DEFAULT_INIT_SIZE;
-  
+
+  tsize = MIN_TSIZE;
+  while(tsize < init_tsize)
+    tsize *= 2;
+
   map->lfactor = lfactor;
-  map->tsize = init_tsize;
-  map->max_n = init_tsize * lfactor;
+  // enough migration per write to drain the old table before the
+  //   new one (twice as big) fills up
+  map->mig_step = MIGRATE_STEP;
+  if(map->mig_step < 1/lfactor + 1)
+    map->mig_step = (int)(1/lfactor) + 1;
 
   map->hfunc = HashFunctions[DEFAULT_HFUNC_ID].hfunc;
+  map->shfunc = HashFunctions[DEFAULT_HFUNC_ID].shfunc;
+  map->seed = 0;
   map->hfunc_desc = HashFunctions[DEFAULT_HFUNC_ID].description;
 
-  map->tbl = create_tbl_array(init_tsize);
- 
+  create_tbl(map, &map->tbl, tsize);
+
   return map;
 }
 
@@ -113,142 +319,278 @@ int hmap_size(HMAP_PTR map) {
   return map->n;
 }
 
-void hmap_display(HMAP_PTR map) {
-  int i, j;
-  
-  for(i=0; i<map->tsize; i++) {
+static void display_tbl(TABLE *t) {
+  int i;
+  unsigned j;
+
+  for(i=0; i<t->tsize; i++) {
     printf("|-|");
-    for(j=0; j<map->tbl[i].n; j++) 
+    for(j=0; j<t->slots[i].psl; j++)
       printf("X");
     printf("\n");
   }
 }
+
+void hmap_display(HMAP_PTR map) {
+  display_tbl(&map->tbl);
+  if(map->old.slots != NULL) {
+    printf("---- being migrated ----\n");
+    display_tbl(&map->old);
+  }
+}
 int hmap_set_hfunc(HMAP_PTR map, int hfunc_id) {
   if(map->n > 0) {
-    fprintf(stderr, 
+    fprintf(stderr,
 	    "warning:  attempt to change hash function on non-empty table\n");
     return 0;
   }
   if(hfunc_id < 0 || hfunc_id >= NumHFuncs) {
-    fprintf(stderr, 
+    fprintf(stderr,
 	    "warning:  invalid hash function id %i\n", hfunc_id);
     return 0;
   }
   map->hfunc = HashFunctions[hfunc_id].hfunc;
+  map->shfunc = HashFunctions[hfunc_id].shfunc;
   map->hfunc_desc = HashFunctions[hfunc_id].description;
   return 1;
 }
 
 int hmap_set_user_hfunc(HMAP_PTR map, HFUNC hfunc, char *desc) {
   if(map->n > 0) {
-    fprintf(stderr, 
+    fprintf(stderr,
 	    "warning:  attempt to change hash function on non-empty table\n");
     return 0;
   }
   map->hfunc = hfunc;
+  map->shfunc = NULL;
   if(desc == NULL)
     map->hfunc_desc = "user-supplied hash function";
-  else 
+  else
     map->hfunc_desc = desc;
   return 1;
 }
 
+int hmap_set_seed(HMAP_PTR map, unsigned long long seed) {
+  if(map->n > 0) {
+    fprintf(stderr,
+	    "warning:  attempt to change hash seed on non-empty table\n");
+    return 0;
+  }
+  map->seed = seed;
+  return map->shfunc != NULL;
+}
 
+int hmap_seed_random(HMAP_PTR map) {
+  unsigned long long seed = 0;
+  FILE *fp;
 
-int hmap_contains(HMAP_PTR map, char *key) {
-  NODE **pp;
-  pp = get_node_pred(map, key);
-  return (*pp == NULL ? 0 : 1);
+  fp = fopen("/dev/urandom", "rb");
+  if(fp == NULL || fread(&seed, sizeof(seed), 1, fp) != 1)
+    seed = (unsigned long long)time(NULL) * WY_P1 ^ (unsigned long long)map;
+  if(fp != NULL)
+    fclose(fp);
+  return hmap_set_seed(map, seed);
 }
 
-void *hmap_get(HMAP_PTR map, char *key) {
-  NODE **pp;
-  pp = get_node_pred(map, key);
-  return (*pp == NULL ? NULL : (*pp)->val);
+unsigned hmap_hash(HMAP_PTR map, char *key) {
+  return hash_key(map, key);
 }
 
-  
-
+unsigned long long hmap_hash64(char *key, unsigned long long seed) {
+  return wyhash64(key, strlen(key), seed);
+}
 
+char *hmap_hfunc_desc(HMAP_PTR map) {
+  return map->hfunc_desc;
+}
 
-  
+void hmap_set_incremental(HMAP_PTR map, int flag) {
+  map->incremental = flag;
+  if(!flag && map->old.slots != NULL)
+    migrate(map, map->old.tsize);
+}
 
-void * hmap_set(HMAP_PTR map, char *key, void *val){
-  unsigned h;
-  int idx;
-  NODE *p, **pp;
 
-  pp = get_node_pred(map, key);
-  p = *pp;
 
-  if(p == NULL) {  // key not present
-    char *key_clone;
+int hmap_contains(HMAP_PTR map, char *key) {
+  KEYREF r;
+  make_ref(&r, key);
+  return find_slot(map, &r, hash_key(map, key), NULL) != NULL;
+}
 
-    key_clone = malloc( (strlen(key) + 1)*sizeof(char));
-    strcpy(key_clone, key);
+void *hmap_get(HMAP_PTR map, char *key) {
+  KEYREF r;
+  SLOT *p;
+  make_ref(&r, key);
+  p = find_slot(map, &r, hash_key(map, key), NULL);
+  return (p == NULL ? NULL : p->val);
+}
 
-    map->n++;
-    if(map->n > map->max_n) 
-      resize(map);
-    h = map->hfunc(key);
-    idx = h % map->tsize;
+int hmap_lookup(HMAP_PTR map, char *key, void **val) {
+  KEYREF r;
+  SLOT *p;
+  make_ref(&r, key);
+  p = find_slot(map, &r, hash_key(map, key), NULL);
+  if(p == NULL)
+    return 0;
+  *val = p->val;
+  return 1;
+}
 
-    p = malloc(sizeof(NODE));
+void **hmap_find_or_insert(HMAP_PTR map, char *key, int *created) {
+  unsigned h;
+  KEYREF r;
+  SLOT *p, entry;
+
+  if(map->old.slots != NULL)
+    migrate(map, map->mig_step);
+  make_ref(&r, key);
+  h = hash_key(map, key);
+  p = find_slot(map, &r, h, NULL);
+  if(created != NULL)
+    *created = (p == NULL);
+  if(p != NULL)
+    return &(p->val);
+
+  if(r.len < INLINE_KEY_LEN)
+    entry.key = r.k;
+  else {
+    memset(&entry.key, 0, sizeof(KEY));
+    entry.key.ext.ptr = malloc( (r.len + 1)*sizeof(char));
+    strcpy(entry.key.ext.ptr, key);
+    entry.key.ext.tag = KEY_EXT;
+    map->key_bytes += r.len + 1;
+  }
+  entry.val = NULL;
+  entry.hval = h;
+
+  if(map->n + 1 > map->max_n)
+    resize(map);
+  p = rh_insert(&map->tbl, entry);
+  map->n++;
+  return &(p->val);
+}
 
-    p->key = key_clone;
-    p->val = val;
-    p->hval = h;
+void * hmap_set(HMAP_PTR map, char *key, void *val){
+  void **vp, *old;
+  int created;
 
-    add_front(&(map->tbl[idx]), p);
-    return NULL;  // no old value to return
-  }
-  else {  // key already in map
-    void *tmp = p->val;
-    p->val = val;
-    return tmp;  // return old value
-  }
+  vp = hmap_find_or_insert(map, key, &created);
+  old = created ? NULL : *vp;  // no old value for a new key
+  *vp = val;
+  return old;
 }
 
 
 void *hmap_remove(HMAP_PTR map, char *key) {
-  NODE *p, **pp;
+  KEYREF r;
+  SLOT *p;
+  TABLE *t;
+  void *val;
 
-  pp = get_node_pred(map, key);
-  p = *pp;
-  if(p == NULL){
+  if(map->old.slots != NULL)
+    migrate(map, map->mig_step);
+  make_ref(&r, key);
+  p = find_slot(map, &r, hash_key(map, key), &t);
+  if(p == NULL)
     return NULL;
+  val = p->val;
+  free_key(map, p);
+  rh_delete(t, p);
+  map->n--;
+  return val;
+}
+
+
+
+static double probe_stats(TABLE *t, HMAP_STATS *stats) {
+  int i, probe;
+  double total = 0;
+
+  for(i=0; i<t->tsize; i++) {
+    if(t->slots[i].psl == 0)
+      continue;
+    probe = t->slots[i].psl;
+    total += probe;
+    if(probe > stats->max_probe)
+      stats->max_probe = probe;
+    stats->probe_hist[probe <= HMAP_HIST_LEN ? probe - 1 : HMAP_HIST_LEN - 1]++;
   }
-  else {
-    unsigned idx;
-    void *val = p->val;
-
-    *pp = p->next;  // make predecessor skip node
-    //   being removed
-    free(p->key);
-    free(p);
-
-    idx = (p->hval) % map->tsize;
-    map->tbl[idx].n--;
-    map->n--;
-    return val;
-  }
+  return total;
 }
-  
 
+void hmap_get_stats(HMAP_PTR map, HMAP_STATS *stats) {
+  double total;
+
+  memset(stats, 0, sizeof(HMAP_STATS));
+  stats->n = map->n;
+  stats->tsize = map->tbl.tsize;
+  stats->load_factor = (double)map->n / map->tbl.tsize;
+  total = probe_stats(&map->tbl, stats);
+  stats->bytes_allocated = sizeof(struct hmap) + map->tbl.tsize*sizeof(SLOT)
+    + map->key_bytes;
+  if(map->old.slots != NULL) {
+    total += probe_stats(&map->old, stats);
+    stats->bytes_allocated += map->old.tsize*sizeof(SLOT);
+  }
+  stats->mean_probe = map->n > 0 ? total / map->n : 0;
+  stats->resize_count = map->resize_count;
+  stats->hfunc_desc = map->hfunc_desc;
+}
 
 void hmap_print_stats(HMAP_PTR map) {
+  HMAP_STATS st;
+  int i;
+
+  hmap_get_stats(map, &st);
+  printf("hash function:    %s\n", st.hfunc_desc);
+  printf("keys / slots:     %i / %i (load factor %.3f)\n",
+	 st.n, st.tsize, st.load_factor);
+  printf("probe length:     mean %.3f, max %i\n", st.mean_probe, st.max_probe);
+  printf("resizes:          %i\n", st.resize_count);
+  printf("bytes allocated:  %lu\n", st.bytes_allocated);
+  printf("probe length histogram:\n");
+  for(i=0; i<HMAP_HIST_LEN; i++) {
+    if(st.probe_hist[i] == 0)
+      continue;
+    printf("  %2i%s %i\n", i+1, i == HMAP_HIST_LEN-1 ? "+:" : ":",
+	   st.probe_hist[i]);
+  }
+}
 
-  printf("sorry, hmap_print_stats() not implemented\n");
+void hmap_dump_stats(HMAP_PTR map, FILE *fp) {
+  HMAP_STATS st;
+  int i;
 
+  hmap_get_stats(map, &st);
+  fprintf(fp, "{\"n\": %i, \"tsize\": %i, \"load_factor\": %.6f, "
+	  "\"mean_probe\": %.6f, \"max_probe\": %i, \"resize_count\": %i, "
+	  "\"bytes_allocated\": %lu, \"probe_hist\": [",
+	  st.n, st.tsize, st.load_factor, st.mean_probe, st.max_probe,
+	  st.resize_count, st.bytes_allocated);
+  for(i=0; i<HMAP_HIST_LEN; i++)
+    fprintf(fp, "%s%i", i == 0 ? "" : ", ", st.probe_hist[i]);
+  fprintf(fp, "]}\n");
 }
 
-void hmap_free(HMAP_PTR map, int free_vals) {
+static void free_tbl(HMAP_PTR map, TABLE *t, int free_vals) {
   int i;
 
-  for(i=0; i<map->tsize; i++) 
-    free_lst(map->tbl[i].members, free_vals);
-  free(map->tbl);
-  map->tbl = NULL;  // not needed
+  for(i=0; i<t->tsize; i++) {
+    if(t->slots[i].psl == 0)
+      continue;
+    free_key(map, &t->slots[i]);
+    if(free_vals && t->slots[i].val != NULL)
+      free(t->slots[i].val);
+  }
+  free(t->slots);
+  t->slots = NULL;
+}
+
+void hmap_free(HMAP_PTR map, int free_vals) {
+  free_tbl(map, &map->tbl, free_vals);
+  if(map->old.slots != NULL)
+    free_tbl(map, &map->old, free_vals);
   free(map);
 }
 
@@ -256,78 +598,188 @@ void hmap_free(HMAP_PTR map, int free_vals) {
 
 /**** UTILITY FUNCTIONS *******/
 
-static int match(char *key, unsigned hval, NODE *p) {
-  return (p->hval == hval && strcmp(key, p->key)==0);
+static unsigned hash_key(HMAP_PTR map, char *key) {
+  if(map->shfunc != NULL)
+    return map->shfunc(key, map->seed);
+  return map->hfunc(key);
 }
 
-static NODE **get_node_pred(HMAP_PTR map, char *key) {
-  unsigned h;
-  int i;
-  NODE **pp;
-  h = map->hfunc(key);
-  i = h % map->tsize;
-
-  pp =&(map->tbl[i].members); 
-  while( *pp != NULL) {
-    if(match(key, h, *pp)) 
-      return pp;
-    pp = &((*pp)->next);
+static void make_ref(KEYREF *r, char *key) {
+  r->s = key;
+  r->len = strlen(key);
+  if(r->len < INLINE_KEY_LEN) {
+    memset(&r->k, 0, sizeof(KEY));
+    memcpy(r->k.inl, key, r->len);
   }
-  return pp;
 }
 
-static void add_front(TBL_ENTRY *entry, NODE *p) {
-  entry->n++;
-  p->next = entry->members;
-  entry->members = p;
+static int same_inline(KEY *a, KEY *b) {
+#ifdef __SSE2__
+  __m128i x = _mm_loadu_si128((__m128i *)a);
+  __m128i y = _mm_loadu_si128((__m128i *)b);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+#else
+  return memcmp(a, b, sizeof(KEY)) == 0;
+#endif
 }
 
-static TBL_ENTRY *create_tbl_array(int tsize) {
-  int i;
-  TBL_ENTRY *tbl;
-  NODE *p;
+static int match(KEYREF *r, unsigned hval, SLOT *p) {
+  if(p->hval != hval)
+    return 0;
+  if(r->len < INLINE_KEY_LEN)
+    return same_inline(&r->k, &p->key);  // never equal to an EXT key
+  return p->key.ext.tag == KEY_EXT && strcmp(r->s, p->key.ext.ptr) == 0;
+}
 
-  tbl = malloc(tsize * sizeof(TBL_ENTRY));
-  for(i=0; i<tsize; i++) {
-    tbl[i].members = NULL;
-    tbl[i].n = 0;
+static void free_key(HMAP_PTR map, SLOT *p) {
+  if(p->key.ext.tag == KEY_EXT) {
+    map->key_bytes -= strlen(p->key.ext.ptr) + 1;
+    free(p->key.ext.ptr);  // made our own copy
   }
-  return tbl;
 }
 
-static void resize(HMAP_PTR map) {
-  int ntsize;
-  TBL_ENTRY *ntbl;
-  NODE *nxt, *p;
-  unsigned h;
-  int i, idx;
-
-  ntsize = 2*map->tsize;
-  ntbl = create_tbl_array(ntsize);
-
-  for(i=0; i<map->tsize; i++) {
-    p = map->tbl[i].members;
-    while(p != NULL) {
-      nxt = p->next;
-      // h = map->hfunc(key);  // no need to recompute
-      idx = p->hval % ntsize;
-      add_front(&ntbl[idx], p);
-      p = nxt;
+/* Fibonacci hashing spreads weak hash values over the high bits */
+static unsigned home_of(TABLE *t, unsigned h) {
+  return (h * FIB_MULT) >> t->shift;
+}
+
+static SLOT *find_in(TABLE *t, KEYREF *r, unsigned h) {
+  unsigned i, dist, mask = t->tsize - 1;
+  SLOT *p;
+
+  i = home_of(t, h);
+  for(dist = 0; ; dist++) {
+    p = &(t->slots[i]);
+    if(p->psl <= dist)  // empty, or closer to home than we are
+      return NULL;
+    if(match(r, h, p))
+      return p;
+    i = (i + 1) & mask;
+  }
+}
+
+/* looks in the current table, then in the undrained part of the old one */
+static SLOT *find_slot(HMAP_PTR map, KEYREF *r, unsigned h, TABLE **where) {
+  SLOT *p;
+  TABLE *t = &map->tbl;
+
+  p = find_in(t, r, h);
+  if(p == NULL && map->old.slots != NULL && home_of(&map->old, h) >= (unsigned)map->mig) {
+    t = &map->old;
+    p = find_in(t, r, h);
+  }
+  if(where != NULL)
+    *where = t;
+  return p;
+}
+
+/**
+ * places entry (whose key must not be in the table) and returns
+ *   the slot it ended up in.  Richer entries (closer to home) are
+ *   displaced towards the end of the run.
+ */
+static SLOT *rh_insert(TABLE *t, SLOT entry) {
+  unsigned i, mask = t->tsize - 1;
+  SLOT *p, *placed = NULL, tmp;
+
+  entry.psl = 1;
+  i = home_of(t, entry.hval);
+  for(;;) {
+    p = &(t->slots[i]);
+    if(p->psl == 0) {
+      *p = entry;
+      return placed == NULL ? p : placed;
     }
+    if(p->psl < entry.psl) {
+      tmp = *p;
+      *p = entry;
+      entry = tmp;
+      if(placed == NULL)
+	placed = p;
+    }
+    entry.psl++;
+    i = (i + 1) & mask;
   }
-  free(map->tbl);
-  map->tbl = ntbl;
-  map->tsize = ntsize;
-  map->max_n = (int)(ntsize * map->lfactor);
+}
 
+/* backward-shift deletion: no tombstones */
+static void rh_delete(TABLE *t, SLOT *p) {
+  unsigned i, nxt, mask = t->tsize - 1;
+
+  i = p - t->slots;
+  nxt = (i + 1) & mask;
+  while(t->slots[nxt].psl > 1) {
+    t->slots[i] = t->slots[nxt];
+    t->slots[i].psl--;
+    i = nxt;
+    nxt = (i + 1) & mask;
+  }
+  memset(&t->slots[i], 0, sizeof(SLOT));
 }
-static void free_lst(NODE *l, int free_vals) {
-  if(l == NULL) return;
-  free_lst(l->next, free_vals );
-  free(l->key);  // made our own copy
-  if(free_vals &&  l->val != NULL)
-    free(l->val);
-  free(l);
+
+static void create_tbl(HMAP_PTR map, TABLE *t, int tsize) {
+  int lg = 0;
+
+  while((1 << lg) < tsize)
+    lg++;
+  t->slots = calloc(tsize, sizeof(SLOT));
+  t->tsize = tsize;
+  t->shift = 32 - lg;
+  map->max_n = (int)(tsize * map->lfactor);
+  if(map->max_n >= tsize)
+    map->max_n = tsize - 1;
+}
+
+/**
+ * moves the entries of the next nslots home slots of the old
+ *   table into the current one; frees the old table once it is
+ *   drained.
+ */
+static void migrate(HMAP_PTR map, int nslots) {
+  TABLE *old = &map->old;
+  unsigned mask = old->tsize - 1, dist;
+  SLOT *p, entry;
+
+  for(; nslots > 0 && map->mig < old->tsize; nslots--, map->mig++) {
+    // entries homed at mig form a run (with psl dist+1 at
+    //   mig+dist) inside the cluster that contains mig
+    for(dist = 0; ; ) {
+      p = &(old->slots[(map->mig + dist) & mask]);
+      if(p->psl <= dist)
+	break;
+      if(p->psl == dist + 1) {
+	entry = *p;
+	rh_delete(old, p);  // shifts the next entry into p
+	rh_insert(&map->tbl, entry);
+      }
+      else
+	dist++;
+    }
+  }
+  if(map->mig == old->tsize) {
+    free(old->slots);
+    old->slots = NULL;
+  }
 }
-/**** END UTILITY FUNCTIONS *******/
 
+static void resize(HMAP_PTR map) {
+  TABLE otbl;
+  int i;
+
+  if(map->old.slots != NULL)  // previous migration still running
+    migrate(map, map->old.tsize);
+  otbl = map->tbl;
+  create_tbl(map, &map->tbl, 2*otbl.tsize);
+  map->resize_count++;
+
+  if(map->incremental) {
+    map->old = otbl;
+    map->mig = 0;
+    return;
+  }
+  for(i=0; i<otbl.tsize; i++)
+    if(otbl.slots[i].psl != 0)
+      rh_insert(&map->tbl, otbl.slots[i]);  // hval is stored: no need to rehash
+  free(otbl.slots);
+}
+/**** END UTILITY FUNCTIONS *******/
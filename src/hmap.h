@@ -2,10 +2,36 @@ typedef unsigned (*HFUNC)(char *);
 
 typedef struct hmap *HMAP_PTR;
 
+#define HMAP_HIST_LEN 16
+
+/**
+ * Snapshot of a map's shape, filled in by hmap_get_stats.
+ *
+ * A key's probe length is the number of slots a lookup for it 
+ *   inspects (1 if it sits in its home slot).  probe_hist[i] 
+ *   counts keys with probe length i+1; the last entry also counts
+ *   every longer probe.
+ */
+typedef struct {
+  int n;
+  int tsize;
+  double load_factor;
+  int probe_hist[HMAP_HIST_LEN];
+  int max_probe;
+  double mean_probe;
+  int resize_count;
+  unsigned long bytes_allocated;  // table, key copies and map header
+  char *hfunc_desc;
+} HMAP_STATS;
+
 
 #define NAIVE_HFUNC 0
 #define BASIC_WEIGHTED_HFUNC 1
+#define WYHASH_HFUNC 2
+#define XXHASH_HFUNC 3
 
+/* the word-at-a-time functions (and a seed against crafted keys)
+ *   are opt-in: hmap_set_hfunc, then hmap_set_seed/hmap_seed_random */
 #define DEFAULT_HFUNC_ID BASIC_WEIGHTED_HFUNC
 
 #define DEFAULT_INIT_SIZE 128
@@ -17,12 +43,13 @@ typedef struct hmap *HMAP_PTR;
  *   given initial table size and specified load factor.
  *
  * \param init_tsize specifies the desired initial 
- *    table size.  If zero is passed, a default table
- *    size is used.
+ *    table size (rounded up to a power of two).  If zero 
+ *    is passed, a default table size is used.
  *
  * \param lfactor specifies the desired maximum load factor;
  *    if zero or a negative number is passed, a default 
- *    load factor is used.
+ *    load factor is used.  The table is open-addressed, so 
+ *    load factors above 0.95 are capped.
  * \returns HMAP_PTR giving a handle to an initialized 
  *    empty hash map.
  */
@@ -58,6 +85,55 @@ extern int hmap_set_hfunc(HMAP_PTR map, int hfunc_id);
  */
 extern int hmap_set_user_hfunc(HMAP_PTR map, HFUNC hfunc, char *desc);
 
+/**
+ * sets the seed mixed into the built-in word-at-a-time hash
+ *   functions (WYHASH_HFUNC, XXHASH_HFUNC); a per-map secret seed
+ *   keeps crafted key sets from piling into one probe run.
+ * if table non-empty, seed is unchanged and 0 is returned.
+ * Also returns 0 if the current hash function takes no seed 
+ *   (the seed is kept in case the hash function is changed).
+ */
+extern int hmap_set_seed(HMAP_PTR map, unsigned long long seed);
+
+/**
+ * hmap_set_seed with a seed read from /dev/urandom (falling 
+ *   back to the clock).
+ */
+extern int hmap_seed_random(HMAP_PTR map);
+
+/**
+ * \returns the hash value the map computes for key with its
+ *   current hash function and seed.
+ */
+extern unsigned hmap_hash(HMAP_PTR map, char *key);
+
+/**
+ * \returns the full 64-bit value of the seeded wyhash-style 
+ *   function behind WYHASH_HFUNC, for other hashed structures
+ *   (mphf, the load shards) that need a good string hash.
+ */
+extern unsigned long long hmap_hash64(char *key, unsigned long long seed);
+
+/**
+ * \returns description of the map's current hash function.
+ */
+extern char *hmap_hfunc_desc(HMAP_PTR map);
+
+/**
+ * turns incremental resizing on (flag non-zero) or off.
+ *
+ * By default a resize rehashes the whole table inside the 
+ *   hmap_set that triggers it.  In incremental mode the new 
+ *   table is allocated and the old one kept alongside it; every
+ *   later hmap_set/hmap_remove moves a bounded number of old 
+ *   slots over, so no single write pays for rehashing the whole
+ *   table.  While a migration is under way a lookup may probe 
+ *   both tables.
+ *
+ * Turning the mode off finishes any migration in progress.
+ */
+extern void hmap_set_incremental(HMAP_PTR map, int flag);
+
 
 /**
  * determines if the given key is in the table and returns
@@ -80,6 +156,26 @@ extern int hmap_contains(HMAP_PTR map, char *key);
  */
 extern void *hmap_get(HMAP_PTR map, char *key);
 
+/**
+ * single-pass lookup that can tell a NULL value from a missing 
+ *   key.
+ * \returns 1 and sets *val to the associated value if key is in
+ *   the table; returns 0 (and leaves *val alone) otherwise.
+ */
+extern int hmap_lookup(HMAP_PTR map, char *key, void **val);
+
+/**
+ * finds the entry for key, creating it with a NULL value if key
+ *   is not in the table -- with a single hash computation.
+ *
+ * \param created (out, may be NULL) set to 1 if the entry was
+ *   created by this call, to 0 if it already existed.
+ * \returns pointer to the value field of the entry, through 
+ *   which the caller reads or sets the value.  The pointer is 
+ *   only valid until the next call that modifies the map.
+ */
+extern void **hmap_find_or_insert(HMAP_PTR map, char *key, int *created);
+
 /**
  * sets the value associated with key to the given value
  *   (val).
@@ -101,12 +197,23 @@ extern void *hmap_remove(HMAP_PTR map, char *key);
 
 
 /**
- * Prints statistical information about the map.
- *
- * currently unimplemented
+ * fills in *stats with the current statistics of the map.
+ * Runtime:  O(table size)
+ */
+extern void hmap_get_stats(HMAP_PTR map, HMAP_STATS *stats);
+
+/**
+ * Prints statistical information about the map (see 
+ *   HMAP_STATS) in human-readable form.
  */
 extern void hmap_print_stats(HMAP_PTR map); 
 
+/**
+ * Writes the statistics of the map to fp as a single line of 
+ *   JSON, for collection by monitoring scripts.
+ */
+extern void hmap_dump_stats(HMAP_PTR map, FILE *fp);
+
 /**
  * Deallocates all memory internally allocated for the map
  *
@@ -0,0 +1,496 @@
+/**
+ * Parallel graph construction.
+ *
+ * The file is mapped and its edge lines cut into one line-aligned
+ *   chunk per thread.  Each thread parses its chunk into a private
+ *   edge buffer, resolving names to temporary ids through NSHARDS
+ *   hmaps, each behind its own mutex (the shard of a name is fixed by
+ *   its hash, so threads rarely wait on one another).
+ *
+ * Temporary ids are handed out in whatever order the threads get
+ *   there.  To get the ids g_from_stream would have given, every name
+ *   also records the file offset of its first occurrence; sorting the
+ *   names by it recovers the sequential first-seen order.
+ *
+ * The CSR arrays are then built without locks: degrees are counted
+ *   with atomic adds, a prefix sum turns them into offsets (each
+ *   thread sums the degrees of a block of vertices, the block sums
+ *   are added up in thread order, then each thread writes its block's
+ *   offsets), and the edges are scattered through atomic per-vertex
+ *   cursors.  A last
+ *   pass sorts each vertex's edges back into file order (latest line
+ *   first, as g_from_stream_csr has them), so the graph is the same as
+ *   the sequential loaders build, whatever the thread count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define MAX_THREADS 64
+#define NSHARDS 64
+#define MAX_NUM_LEN 63    // longest weight (or header) token accepted
+
+#define PHASE_PARSE 0
+#define PHASE_COUNT 1
+#define PHASE_SUM 2
+#define PHASE_OFFSETS 3
+#define PHASE_SCATTER 4
+#define PHASE_ORDER 5
+
+typedef struct {
+  int u;
+  int v;
+  weight_t w;
+} PEDGE;
+
+/* one CSR slot before the final ordering pass */
+typedef struct {
+  long seq;         // index of the edge's line among all edges
+  int v;
+  weight_t w;
+} SLOT;
+
+typedef struct loader LOADER;
+
+typedef struct {
+  LOADER *ld;
+  pthread_t tid;
+  int t;
+  const char *lo;   // chunk of the file this worker parses
+  const char *hi;
+  PEDGE *e;         // edges of the chunk, in file order
+  long ne;
+  long cap;
+  long base;        // seq of e[0]
+  long esum;        // edges of its block of vertices, then the
+                    //   block's first CSR slot
+  int failed;
+} PWORKER;
+
+struct loader {
+  GRAPH *g;
+  const char *map;
+  const char *end;  // of the mapping
+  HMAP_PTR shard[NSHARDS];
+  pthread_mutex_t lock[NSHARDS];
+  int ntmp;         // temporary ids handed out
+  long *first;      // temporary id -> offset of first occurrence
+  int *tmp2id;
+  long *cursor;     // next free slot of each vertex
+  SLOT *slots;
+
+  int nthreads;
+  PWORKER *workers;
+  pthread_barrier_t bar;
+  int done;
+  int phase;
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static int is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+ * next token of the line at *p; 0 (with *p on the '\n' or at hi)
+ *   once the line has no more.
+ */
+static int next_token(const char **p, const char *hi, const char **tok,
+		      int *len) {
+  const char *s = *p;
+
+  while(s < hi && is_blank(*s))
+    s++;
+  if(s == hi || *s == '\n') {
+    *p = s;
+    return 0;
+  }
+  *tok = s;
+  while(s < hi && *s != '\n' && !is_blank(*s))
+    s++;
+  *len = s - *tok;
+  *p = s;
+  return 1;
+}
+
+static void push_edge(PWORKER *w, int u, int v, weight_t wt) {
+  if(w->ne == w->cap) {
+    w->cap = w->cap == 0 ? 1024 : 2 * w->cap;
+    w->e = realloc(w->e, w->cap * sizeof(PEDGE));
+  }
+  w->e[w->ne].u = u;
+  w->e[w->ne].v = v;
+  w->e[w->ne].w = wt;
+  w->ne++;
+}
+
+/* lowers *p to x unless it is already smaller */
+static void atomic_min_long(long *p, long x) {
+  long cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+  while(x < cur &&
+	!__atomic_compare_exchange_n(p, &cur, x, 1, __ATOMIC_RELAXED,
+				     __ATOMIC_RELAXED))
+    ;
+}
+
+/* temporary id of the name at tok; -1 once there are more than n */
+static int resolve(LOADER *ld, const char *tok, int len) {
+  char name[MAX_NAME_LEN+1];
+  void **slot;
+  int sh, id, created;
+
+  memcpy(name, tok, len);
+  name[len] = '\0';
+  sh = hmap_hash64(name, 0) % NSHARDS;
+  pthread_mutex_lock(&ld->lock[sh]);
+  slot = hmap_find_or_insert(ld->shard[sh], name, &created);
+  if(created) {
+    id = __atomic_fetch_add(&ld->ntmp, 1, __ATOMIC_RELAXED);
+    if(id >= ld->g->n) {
+      pthread_mutex_unlock(&ld->lock[sh]);
+      return -1;
+    }
+    ld->first[id] = tok - ld->map;
+    *slot = (void*)(long)id;
+  }
+  else
+    id = (int)(long)*slot;
+  pthread_mutex_unlock(&ld->lock[sh]);
+  // the first line with this name may be in an earlier chunk
+  atomic_min_long(&ld->first[id], tok - ld->map);
+  return id;
+}
+
+/*
+ * One edge per line, "src dest weight"; blank lines are skipped.
+ *   Edges are accepted and rejected as by g_from_stream.
+ */
+static void parse_chunk(PWORKER *w) {
+  LOADER *ld = w->ld;
+  const char *p = w->lo, *tok[4];
+  char num[MAX_NUM_LEN+1], *end;
+  int len[4], k, u, v, self;
+  double weight;
+
+  while(p < w->hi) {
+    for(k = 0; k < 4 && next_token(&p, w->hi, &tok[k], &len[k]); k++)
+      ;
+    if(k == 0) {
+      p++;    // past the '\n'
+      continue;
+    }
+    if(k != 3 || len[0] > MAX_NAME_LEN || len[1] > MAX_NAME_LEN
+       || len[2] > MAX_NUM_LEN) {
+      w->failed = 1;
+      return;
+    }
+    memcpy(num, tok[2], len[2]);
+    num[len[2]] = '\0';
+    weight = strtod(num, &end);
+    if(*end != '\0') {
+      w->failed = 1;
+      return;
+    }
+    self = len[0] == len[1] && memcmp(tok[0], tok[1], len[0]) == 0;
+    if(weight > 0 && !self) {
+      u = resolve(ld, tok[0], len[0]);
+      v = resolve(ld, tok[1], len[1]);
+      if(u < 0 || v < 0) {
+	w->failed = 1;
+	return;
+      }
+      push_edge(w, u, v, weight_from_double(weight));
+    }
+    else {
+      if(weight <= 0)
+	fprintf(stderr, "error: non-positive weight. ignoring...\n");
+      if(self)
+	fprintf(stderr, "error: self-loop. ignoring...\n");
+    }
+  }
+}
+
+/* latest line first */
+static int cmp_seq_desc(const void *a, const void *b) {
+  const SLOT *x = a, *y = b;
+  return (x->seq < y->seq) - (x->seq > y->seq);
+}
+
+static void work_phase(LOADER *ld, PWORKER *w) {
+  GRAPH *g = ld->g;
+  PEDGE *e;
+  long i, k, lo, hi;
+  int u;
+
+  // the block of vertices of the per-vertex phases
+  lo = (long)g->n * w->t / ld->nthreads;
+  hi = (long)g->n * (w->t + 1) / ld->nthreads;
+  switch(ld->phase) {
+  case PHASE_PARSE:
+    parse_chunk(w);
+    break;
+  case PHASE_COUNT:
+    for(i = 0; i < w->ne; i++) {
+      e = &w->e[i];
+      e->u = ld->tmp2id[e->u];
+      e->v = ld->tmp2id[e->v];
+      __atomic_fetch_add(&g->vertices[e->u].out_degree, 1, __ATOMIC_RELAXED);
+      if(!g->directed)
+	__atomic_fetch_add(&g->vertices[e->v].out_degree, 1, __ATOMIC_RELAXED);
+    }
+    break;
+  case PHASE_SUM:
+    for(w->esum = 0, u = lo; u < hi; u++)
+      w->esum += g->vertices[u].out_degree;
+    break;
+  case PHASE_OFFSETS:
+    for(k = w->esum, u = lo; u < hi; u++) {
+      g->csr_off[u] = ld->cursor[u] = k;
+      k += g->vertices[u].out_degree;
+    }
+    break;
+  case PHASE_SCATTER:
+    for(i = 0; i < w->ne; i++) {
+      e = &w->e[i];
+      k = __atomic_fetch_add(&ld->cursor[e->u], 1, __ATOMIC_RELAXED);
+      ld->slots[k].seq = w->base + i;
+      ld->slots[k].v = e->v;
+      ld->slots[k].w = e->w;
+      if(g->directed)
+	continue;
+      k = __atomic_fetch_add(&ld->cursor[e->v], 1, __ATOMIC_RELAXED);
+      ld->slots[k].seq = w->base + i;
+      ld->slots[k].v = e->u;
+      ld->slots[k].w = e->w;
+    }
+    break;
+  case PHASE_ORDER:
+    for(u = lo; u < hi; u++) {
+      qsort(ld->slots + g->csr_off[u], g->csr_off[u+1] - g->csr_off[u],
+	    sizeof(SLOT), cmp_seq_desc);
+      for(k = g->csr_off[u]; k < g->csr_off[u+1]; k++) {
+	g->csr_adj[k] = ld->slots[k].v;
+	g->csr_w[k] = ld->slots[k].w;
+      }
+    }
+    break;
+  }
+}
+
+static void *worker_main(void *arg) {
+  PWORKER *w = arg;
+  LOADER *ld = w->ld;
+
+  for(;;) {
+    pthread_barrier_wait(&ld->bar);
+    if(ld->done)
+      break;
+    work_phase(ld, w);
+    pthread_barrier_wait(&ld->bar);
+  }
+  return NULL;
+}
+
+/* runs one phase on all threads; the calling thread is worker 0 */
+static void run_phase(LOADER *ld, int phase) {
+  ld->phase = phase;
+  pthread_barrier_wait(&ld->bar);
+  work_phase(ld, &ld->workers[0]);
+  pthread_barrier_wait(&ld->bar);
+}
+
+static int cmp_first(const void *a, const void *b) {
+  const long *x = a, *y = b;
+  return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/*
+ * Load order ids: temporary ids by offset of first occurrence.  Also
+ *   interns the names, in id order.
+ */
+static void number_names(LOADER *ld, int k) {
+  long *byfirst = malloc(sizeof(long) * 2 * (k > 0 ? k : 1));
+  char name[MAX_NAME_LEN+1];
+  const char *tok, *end;
+  int i;
+
+  for(i = 0; i < k; i++) {
+    byfirst[2*i] = ld->first[i];
+    byfirst[2*i+1] = i;
+  }
+  qsort(byfirst, k, 2 * sizeof(long), cmp_first);
+  for(i = 0; i < k; i++) {
+    ld->tmp2id[byfirst[2*i+1]] = i;
+    tok = end = ld->map + byfirst[2*i];
+    while(end < ld->end && *end != '\n' && !is_blank(*end))
+      end++;
+    memcpy(name, tok, end - tok);
+    name[end - tok] = '\0';
+    g_intern_name(ld->g, i, name);
+  }
+  free(byfirst);
+}
+
+/* first line boundary at or after p */
+static const char * line_start(const char *p, const char *lo, const char *hi) {
+  if(p == lo)
+    return p;
+  while(p < hi && p[-1] != '\n')
+    p++;
+  return p;
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+GRAPH * g_from_file_parallel(const char *path, int nthreads) {
+  LOADER ld;
+  GRAPH *g = NULL;
+  struct stat st;
+  const char *p, *hi, *tok, *body;
+  char num[MAX_NUM_LEN+1], *end;
+  int fd, n, len, t, k, failed, directed;
+  long m, e, s;
+  void *map;
+
+  if(nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if(nthreads <= 0)
+    nthreads = 1;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0
+     || st.st_size == 0) {
+    if(fd >= 0)
+      close(fd);
+    fprintf(stderr, "g_from_file_parallel failed\n");
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    fprintf(stderr, "g_from_file_parallel failed\n");
+    return NULL;
+  }
+
+  // header: the vertex count, as a C integer constant like "%i",
+  //   then "directed" for one-way edges
+  p = map;
+  hi = p + st.st_size;
+  while(p < hi && (is_blank(*p) || *p == '\n'))
+    p++;
+  if(!next_token(&p, hi, &tok, &len) || len > MAX_NUM_LEN) {
+    munmap(map, st.st_size);
+    fprintf(stderr, "g_from_file_parallel failed\n");
+    return NULL;
+  }
+  memcpy(num, tok, len);
+  num[len] = '\0';
+  n = strtol(num, &end, 0);
+  directed = 0;
+  if(next_token(&p, hi, &tok, &len))
+    directed = len == 8 && memcmp(tok, "directed", 8) == 0 ? 1 : -1;
+  if(*end != '\0' || n <= 0 || directed < 0) {
+    munmap(map, st.st_size);
+    fprintf(stderr, "g_from_file_parallel failed\n");
+    return NULL;
+  }
+  body = p;
+
+  ld.g = g_new(n, 0);
+  ld.g->directed = directed;
+  ld.map = map;
+  ld.end = hi;
+  for(k = 0; k < NSHARDS; k++) {
+    ld.shard[k] = hmap_create((unsigned)(n / NSHARDS / DEFAULT_LFACTOR) + 1, 0);
+    pthread_mutex_init(&ld.lock[k], NULL);
+  }
+  ld.ntmp = 0;
+  ld.first = malloc(sizeof(long) * n);
+  ld.tmp2id = malloc(sizeof(int) * n);
+  ld.cursor = NULL;
+  ld.slots = NULL;
+  ld.nthreads = nthreads;
+  ld.done = 0;
+  ld.workers = calloc(nthreads, sizeof(PWORKER));
+  pthread_barrier_init(&ld.bar, NULL, nthreads);
+  for(t = 0; t < nthreads; t++) {
+    ld.workers[t].ld = &ld;
+    ld.workers[t].t = t;
+    ld.workers[t].lo = line_start(body + (hi - body) * t / nthreads, body, hi);
+    if(t > 0) {
+      ld.workers[t-1].hi = ld.workers[t].lo;
+      pthread_create(&ld.workers[t].tid, NULL, worker_main, &ld.workers[t]);
+    }
+  }
+  ld.workers[nthreads-1].hi = hi;
+
+  run_phase(&ld, PHASE_PARSE);
+  failed = 0;
+  for(t = 0, m = 0; t < nthreads; t++) {
+    failed |= ld.workers[t].failed;
+    ld.workers[t].base = m;
+    m += ld.workers[t].ne;
+  }
+  if(!failed) {
+    number_names(&ld, ld.ntmp);
+    run_phase(&ld, PHASE_COUNT);
+
+    g = ld.g;
+    g->csr_off = malloc(sizeof(long) * (n + 1));
+    ld.cursor = malloc(sizeof(long) * n);
+    run_phase(&ld, PHASE_SUM);
+    for(t = 0, e = 0; t < nthreads; t++) {
+      s = ld.workers[t].esum;
+      ld.workers[t].esum = e;
+      e += s;
+    }
+    run_phase(&ld, PHASE_OFFSETS);
+    g->csr_off[n] = e;
+    g->csr_adj = malloc(sizeof(int) * (e > 0 ? e : 1));
+    g->csr_w = malloc(sizeof(weight_t) * (e > 0 ? e : 1));
+    g->adj_mode = ADJ_CSR;
+    ld.slots = malloc(sizeof(SLOT) * (e > 0 ? e : 1));
+    run_phase(&ld, PHASE_SCATTER);
+    run_phase(&ld, PHASE_ORDER);
+    g_freeze_names(g);
+  }
+  else {
+    g_free(ld.g);
+    fprintf(stderr, "g_from_file_parallel failed\n");
+  }
+
+  ld.done = 1;
+  pthread_barrier_wait(&ld.bar);
+  for(t = 0; t < nthreads; t++) {
+    if(t > 0)
+      pthread_join(ld.workers[t].tid, NULL);
+    free(ld.workers[t].e);
+  }
+  pthread_barrier_destroy(&ld.bar);
+  for(k = 0; k < NSHARDS; k++) {
+    hmap_free(ld.shard[k], 0);
+    pthread_mutex_destroy(&ld.lock[k]);
+  }
+  free(ld.workers);
+  free(ld.first);
+  free(ld.tmp2id);
+  free(ld.cursor);
+  free(ld.slots);
+  munmap(map, st.st_size);
+  return g;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmap.h"
+#include "mphf.h"
+
+#ifndef MAX_LEVELS
+#define MAX_LEVELS 24   // test_mphf builds with fewer to reach the fallback
+#endif
+#define RANK_WORDS 8     // one rank sample per 8 words (512 bits)
+#define SEED_BASE 0x9e3779b97f4a7c15ull
+
+
+/******** STRUCTS AND TYPEDEFS *********/
+
+/**
+ * Level l is a bit array of size[l] bits.  A key lands on bit
+ *   hash_l(key) mod size[l]; keys that land alone on a bit own it
+ *   (the bit is set), keys that collide move on to level l+1.  A
+ *   key's index is the number of set bits before its bit in the
+ *   concatenation of all levels.  The few keys still colliding
+ *   after MAX_LEVELS levels are kept in a small hmap.
+ */
+struct mphf {
+  int n;
+  int nlevels;
+  unsigned long size[MAX_LEVELS];
+  unsigned long offset[MAX_LEVELS];  // first bit of level l
+  unsigned long long *bits;          // all levels, concatenated
+  unsigned long nwords;
+  unsigned *rank;                    // set bits before each sample
+  HMAP_PTR fallback;                 // key -> index + 1
+  int nplaced;                       // keys placed through the bits
+};
+
+/******** END STRUCTS AND TYPEDEFS *********/
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static unsigned long level_pos(char *key, int level, unsigned long size) {
+  unsigned long long h = hmap_hash64(key, SEED_BASE * (level + 1));
+  return (unsigned long)(((unsigned __int128)h * size) >> 64);
+}
+
+static int test_bit(unsigned long long *bits, unsigned long i) {
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static void set_bit(unsigned long long *bits, unsigned long i) {
+  bits[i >> 6] |= 1ull << (i & 63);
+}
+
+static unsigned long rank_of(MPHF *f, unsigned long i) {
+  unsigned long w = i >> 6, r, k;
+
+  r = f->rank[w / RANK_WORDS];
+  for(k = w - w % RANK_WORDS; k < w; k++)
+    r += __builtin_popcountll(f->bits[k]);
+  return r + __builtin_popcountll(f->bits[w] & ((1ull << (i & 63)) - 1));
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+MPHF * mphf_build(char **keys, int n, double gamma) {
+  MPHF *f;
+  char **cur, **next;
+  unsigned long long *seen, *coll;
+  unsigned long size, total = 0, pos, w;
+  int ncur, nnext, i, l;
+
+  if(n < 0)
+    return NULL;
+  if(gamma < 1)
+    gamma = MPHF_DEFAULT_GAMMA;
+
+  f = calloc(1, sizeof(MPHF));
+  f->n = n;
+  f->bits = NULL;
+  cur = malloc((n > 0 ? n : 1) * sizeof(char*));
+  next = malloc((n > 0 ? n : 1) * sizeof(char*));
+  memcpy(cur, keys, n * sizeof(char*));
+  ncur = n;
+
+  for(l = 0; l < MAX_LEVELS && ncur > 0; l++) {
+    size = ((unsigned long)(gamma * ncur) + 63) & ~63ul;
+    f->size[l] = size;
+    f->offset[l] = total;
+    f->bits = realloc(f->bits, (total + size) / 64 * sizeof(unsigned long long));
+    seen = f->bits + total / 64;
+    memset(seen, 0, size / 8);
+    coll = calloc(size / 64, sizeof(unsigned long long));
+
+    for(i = 0; i < ncur; i++) {
+      pos = level_pos(cur[i], l, size);
+      if(test_bit(seen, pos))
+	set_bit(coll, pos);
+      else
+	set_bit(seen, pos);
+    }
+    for(w = 0; w < size / 64; w++)
+      seen[w] &= ~coll[w];
+    nnext = 0;
+    for(i = 0; i < ncur; i++)
+      if(test_bit(coll, level_pos(cur[i], l, size)))
+	next[nnext++] = cur[i];
+    free(coll);
+
+    total += size;
+    f->nplaced += ncur - nnext;
+    memcpy(cur, next, nnext * sizeof(char*));
+    ncur = nnext;
+  }
+  f->nlevels = l;
+  f->nwords = total / 64;
+
+  f->rank = malloc((f->nwords / RANK_WORDS + 1) * sizeof(unsigned));
+  for(w = 0, total = 0; w < f->nwords; w++) {
+    if(w % RANK_WORDS == 0)
+      f->rank[w / RANK_WORDS] = total;
+    total += __builtin_popcountll(f->bits[w]);
+  }
+
+  f->fallback = NULL;
+  if(ncur > 0) {
+    f->fallback = hmap_create(ncur, 0);
+    for(i = 0; i < ncur; i++)
+      hmap_set(f->fallback, cur[i], (void*)(long)(f->nplaced + i + 1));
+  }
+  free(cur);
+  free(next);
+  return f;
+}
+
+int mphf_lookup(MPHF *f, char *key) {
+  unsigned long pos;
+  int l;
+
+  for(l = 0; l < f->nlevels; l++) {
+    pos = f->offset[l] + level_pos(key, l, f->size[l]);
+    if(test_bit(f->bits, pos))
+      return (int)rank_of(f, pos);
+  }
+  if(f->fallback != NULL)
+    return (int)(long)hmap_get(f->fallback, key) - 1;
+  return -1;
+}
+
+int mphf_size(MPHF *f) {
+  return f->n;
+}
+
+unsigned long mphf_bytes(MPHF *f) {
+  unsigned long b;
+  HMAP_STATS st;
+
+  b = sizeof(MPHF) + f->nwords * sizeof(unsigned long long)
+    + (f->nwords / RANK_WORDS + 1) * sizeof(unsigned);
+  if(f->fallback != NULL) {
+    hmap_get_stats(f->fallback, &st);
+    b += st.bytes_allocated;
+  }
+  return b;
+}
+
+void mphf_free(MPHF *f) {
+  if(f->fallback != NULL)
+    hmap_free(f->fallback, 0);
+  free(f->bits);
+  free(f->rank);
+  free(f);
+}
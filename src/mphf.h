@@ -0,0 +1,43 @@
+/**
+ * General description:  minimal perfect hash function over a
+ *   fixed set of n string keys (BBHash construction).
+ *
+ *   Every key of the set is mapped to a distinct index in
+ *   [0..n-1] with a few bit lookups and no stored keys; about
+ *   3-4 bits per key for the default gamma.  A key outside the
+ *   set gets -1 or an arbitrary index, so callers that may see
+ *   foreign keys must verify the hit against their own copy of
+ *   the key.
+ **/
+
+typedef struct mphf MPHF;
+
+#define MPHF_DEFAULT_GAMMA (2.0)
+
+/**
+ * Builds the function for keys[0..n-1] (which must be distinct).
+ *
+ * \param gamma trades space for build and lookup speed: each
+ *   level gets gamma bits per remaining key.  Zero or a value
+ *   below 1 selects MPHF_DEFAULT_GAMMA.
+ * \returns the new function; NULL if n < 0.
+ */
+extern MPHF * mphf_build(char **keys, int n, double gamma);
+
+/**
+ * \returns the index of key if it is in the set the function was
+ *   built for.  For other keys returns -1 or any index.
+ */
+extern int mphf_lookup(MPHF *f, char *key);
+
+/**
+ * \returns number of keys the function was built for.
+ */
+extern int mphf_size(MPHF *f);
+
+/**
+ * \returns total bytes allocated by the function.
+ */
+extern unsigned long mphf_bytes(MPHF *f);
+
+extern void mphf_free(MPHF *f);
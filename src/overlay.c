@@ -0,0 +1,612 @@
+/**
+ * Customizable route planning: a multilevel overlay on a partition
+ *   of the vertices (partition.c).
+ *
+ * The partition depends on the edges only and is made once by
+ *   g_overlay_create.  For every cell of every level the overlay
+ *   keeps the cell's boundary vertices (those with an edge to another
+ *   cell of that level) and their clique: the length of the shortest
+ *   path inside the cell from each of them to each other.
+ *   g_overlay_customize recomputes the cliques from the current
+ *   weights, bottom up: a level-0 cell by Dijkstra on its own edges,
+ *   a higher one by Dijkstra on the boundary vertices of its subcells,
+ *   joined by their cliques and by the edges between the subcells.
+ *   The cells of a level do not depend on each other and are shared
+ *   out among worker threads (with the barrier scheme of dstep.c).
+ *
+ * A query runs Dijkstra from the target towards the source.  In the
+ *   level-0 cells of the two it follows the graph's edges; everywhere
+ *   else a vertex is crossed by its clique at the highest level whose
+ *   cell holds neither endpoint, and left by the edges out of that
+ *   cell.  Each clique edge on the result is then expanded by Dijkstra
+ *   restricted to its cell.  The report covers that path only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "pq.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define MAX_THREADS 64
+#define MAX_LEVELS 8
+#define DEFAULT_CELL 256   // vertices per level-0 cell
+#define DEFAULT_LEVELS 2
+#define FANOUT 16          // growth in cell size from one level to the next
+
+typedef struct {
+  int *items;
+  int n;
+  int cap;
+} IVEC;
+
+typedef struct {
+  long *bstart;     // boundary vertices of cell c:
+  int *bv;          //   bv[bstart[c] .. bstart[c+1]-1]
+  int *bidx;        // index of v among them, -1 if v is not one
+  long *nstart;     // what customizing cell c searches: nodes[nstart[c]
+  int *nodes;       //   .. nstart[c+1]-1], its vertices at level 0, the
+  int *nidx;        //   boundary vertices of its subcells above
+  long *mstart;     // clique of cell c with b boundary vertices: b x b,
+  dist_t *clique;   //   row i (from bv i) at clique[mstart[c] + i*b]
+} OV_LEVEL;
+
+struct overlay {
+  GRAPH *g;
+  PARTITION *p;
+  OV_LEVEL *lv;
+  int maxnodes;            // most nodes of any cell
+  unsigned long id_gen;    // of g when built
+  unsigned long edge_gen;  // of g when last customized
+  int customized;          // 0 if that customization hit a bad tile
+  PQ *q;                   // query search, by vertex
+  dist_t *sd;
+  int *spar;
+  signed char *slev;       // level of the clique that reached v, -1: an edge
+  unsigned *sstamp;
+  unsigned sepoch;
+  IVEC hopv;               // the search's path, target first, and the
+  IVEC hopl;               //   level of the step into each vertex
+  IVEC path;               // the same, expanded
+  dist_t *d;               // the report
+  int *pred;
+  unsigned *stamp;
+  unsigned epoch;
+  PATH_RPT rpt;
+};
+
+typedef struct customize CUSTOMIZE;
+
+typedef struct {
+  CUSTOMIZE *cz;
+  pthread_t tid;
+  PQ *q;            // by index into the cell's nodes
+  dist_t *d;
+  char *across;     // reached over its subcell's clique
+  unsigned *stamp;
+  unsigned epoch;
+} WORKER;
+
+struct customize {
+  OVERLAY *ov;
+  int nthreads;
+  WORKER *workers;
+  pthread_barrier_t bar;
+  int done;
+  int level;
+  int next;         // next unclaimed cell
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static void ivec_push(IVEC *v, int x) {
+  if(v->n == v->cap) {
+    v->cap = v->cap == 0 ? 64 : 2*v->cap;
+    v->items = realloc(v->items, v->cap*sizeof(int));
+  }
+  v->items[v->n++] = x;
+}
+
+/* 1 if v has an edge, either way, to another cell */
+static int crosses(GRAPH *g, const int *cell, int v) {
+  EDGE_IT it;
+  weight_t w;
+  int u;
+
+  edge_begin(g, v, &it);
+  while(edge_next(&it, &u, &w))
+    if(cell[u] != cell[v])
+      return 1;
+  if(g->directed) {
+    edge_begin_in(g, v, &it);
+    while(edge_next(&it, &u, &w))
+      if(cell[u] != cell[v])
+	return 1;
+  }
+  return 0;
+}
+
+/* boundary vertices, nodes and clique space of level l's cells */
+static void build_level(OVERLAY *ov, int l) {
+  GRAPH *g = ov->g;
+  OV_LEVEL *lv = &ov->lv[l];
+  int nc = ov->p->ncells[l], *cell = ov->p->cell[l], n = g->n, v, c;
+  long *bat = malloc(sizeof(long) * (nc > 0 ? nc : 1)), b;
+  long *nat = malloc(sizeof(long) * (nc > 0 ? nc : 1));
+
+  lv->bstart = calloc(nc + 1, sizeof(long));
+  lv->nstart = calloc(nc + 1, sizeof(long));
+  lv->bidx = malloc(sizeof(int) * (n > 0 ? n : 1));
+  lv->nidx = malloc(sizeof(int) * (n > 0 ? n : 1));
+  for(v = 0; v < n; v++) {
+    lv->bidx[v] = crosses(g, cell, v) ? 0 : -1;
+    lv->nidx[v] = l == 0 || ov->lv[l-1].bidx[v] >= 0 ? 0 : -1;
+    if(lv->bidx[v] >= 0)
+      lv->bstart[cell[v]+1]++;
+    if(lv->nidx[v] >= 0)
+      lv->nstart[cell[v]+1]++;
+  }
+  lv->mstart = malloc(sizeof(long) * (nc + 1));
+  lv->mstart[0] = 0;
+  for(c = 0; c < nc; c++) {
+    b = lv->bstart[c+1];
+    lv->mstart[c+1] = lv->mstart[c] + b * b;
+    if(lv->nstart[c+1] > ov->maxnodes)
+      ov->maxnodes = lv->nstart[c+1];
+    lv->bstart[c+1] += lv->bstart[c];
+    lv->nstart[c+1] += lv->nstart[c];
+    bat[c] = lv->bstart[c];
+    nat[c] = lv->nstart[c];
+  }
+  lv->bv = malloc(sizeof(int) * (lv->bstart[nc] > 0 ? lv->bstart[nc] : 1));
+  lv->nodes = malloc(sizeof(int) * (lv->nstart[nc] > 0 ? lv->nstart[nc] : 1));
+  lv->clique = malloc(sizeof(dist_t) *
+		      (lv->mstart[nc] > 0 ? lv->mstart[nc] : 1));
+  for(v = 0; v < n; v++) {
+    c = cell[v];
+    if(lv->bidx[v] >= 0) {
+      lv->bidx[v] = bat[c] - lv->bstart[c];
+      lv->bv[bat[c]++] = v;
+    }
+    if(lv->nidx[v] >= 0) {
+      lv->nidx[v] = nat[c] - lv->nstart[c];
+      lv->nodes[nat[c]++] = v;
+    }
+  }
+  free(bat);
+  free(nat);
+}
+
+/* lowers the tentative distance of node x to dx */
+static void reach(WORKER *wk, int x, dist_t dx, int across) {
+  if(wk->stamp[x] != wk->epoch) {
+    wk->stamp[x] = wk->epoch;
+    wk->d[x] = dx;
+    wk->across[x] = across;
+    pq_insert(wk->q, x, dx);
+  }
+  else if(dx < wk->d[x] && pq_contains(wk->q, x)) {
+    wk->d[x] = dx;
+    wk->across[x] = across;
+    pq_change_priority(wk->q, x, dx);
+  }
+}
+
+/* the clique of cell c at level l, from the weights (l == 0) or from
+ * the cliques of level l-1 */
+static void customize_cell(OVERLAY *ov, WORKER *wk, int l, int c) {
+  GRAPH *g = ov->g;
+  OV_LEVEL *lv = &ov->lv[l], *sub = l > 0 ? &ov->lv[l-1] : NULL;
+  int *cell = ov->p->cell[l], *subcell = l > 0 ? ov->p->cell[l-1] : NULL;
+  const int *nodes = lv->nodes + lv->nstart[c];
+  const int *bv = lv->bv + lv->bstart[c];
+  long b = lv->bstart[c+1] - lv->bstart[c], sb, i, j;
+  const dist_t *srow;
+  dist_t dx, *row;
+  weight_t w;
+  EDGE_IT it;
+  int x, u, v, sc;
+
+  for(i = 0; i < b; i++) {
+    if(++wk->epoch == 0) {
+      memset(wk->stamp, 0, sizeof(unsigned) * ov->maxnodes);
+      wk->epoch = 1;
+    }
+    reach(wk, lv->nidx[bv[i]], 0, 0);
+    while(pq_delete_top(wk->q, &x, &dx)) {
+      u = nodes[x];
+      // across u's subcell (pointless if that is how u was reached:
+      //   a clique is its own shortcut), then out of it below
+      if(sub != NULL && !wk->across[x]) {
+	sc = subcell[u];
+	sb = sub->bstart[sc+1] - sub->bstart[sc];
+	srow = sub->clique + sub->mstart[sc] + sub->bidx[u] * sb;
+	for(j = 0; j < sb; j++)
+	  if(srow[j] != DIST_INF)
+	    reach(wk, lv->nidx[sub->bv[sub->bstart[sc] + j]],
+		  dist_add(dx, srow[j]), 1);
+      }
+      edge_begin(g, u, &it);
+      while(edge_next(&it, &v, &w))
+	if(cell[v] == c && (sub == NULL || subcell[v] != subcell[u]))
+	  reach(wk, lv->nidx[v], dist_add(dx, w), 0);
+    }
+    row = lv->clique + lv->mstart[c] + i * b;
+    for(j = 0; j < b; j++) {
+      x = lv->nidx[bv[j]];
+      row[j] = wk->stamp[x] == wk->epoch ? wk->d[x] : DIST_INF;
+    }
+  }
+}
+
+static void work_level(CUSTOMIZE *cz, WORKER *wk) {
+  int c;
+
+  while((c = __atomic_fetch_add(&cz->next, 1, __ATOMIC_RELAXED))
+	< cz->ov->p->ncells[cz->level])
+    customize_cell(cz->ov, wk, cz->level, c);
+}
+
+static void *worker_main(void *arg) {
+  WORKER *wk = arg;
+  CUSTOMIZE *cz = wk->cz;
+
+  for(;;) {
+    pthread_barrier_wait(&cz->bar);
+    if(cz->done)
+      break;
+    work_level(cz, wk);
+    pthread_barrier_wait(&cz->bar);
+  }
+  return NULL;
+}
+
+/* customizes every cell of level l on all threads; the calling thread
+ * is worker 0 */
+static void run_level(CUSTOMIZE *cz, int l) {
+  cz->level = l;
+  cz->next = 0;
+  pthread_barrier_wait(&cz->bar);
+  work_level(cz, &cz->workers[0]);
+  pthread_barrier_wait(&cz->bar);
+}
+
+/* highest level at which v's cell holds neither a nor b; -1 if none */
+static int query_level(OVERLAY *ov, int v, int a, int b) {
+  int l, *cell;
+
+  for(l = ov->p->nlevels - 1; l >= 0; l--) {
+    cell = ov->p->cell[l];
+    if(cell[v] != cell[a] && cell[v] != cell[b])
+      return l;
+  }
+  return -1;
+}
+
+static void q_reach(OVERLAY *ov, int v, dist_t dv, int u, int lev) {
+  if(ov->sstamp[v] != ov->sepoch) {
+    ov->sstamp[v] = ov->sepoch;
+    ov->sd[v] = dv;
+    ov->spar[v] = u;
+    ov->slev[v] = lev;
+    pq_insert(ov->q, v, dv);
+  }
+  else if(dv < ov->sd[v] && pq_contains(ov->q, v)) {
+    ov->sd[v] = dv;
+    ov->spar[v] = u;
+    ov->slev[v] = lev;
+    pq_change_priority(ov->q, v, dv);
+  }
+}
+
+static void new_search(OVERLAY *ov) {
+  if(++ov->sepoch == 0) {
+    memset(ov->sstamp, 0, sizeof(unsigned) * ov->g->n);
+    ov->sepoch = 1;
+  }
+}
+
+/* overlay Dijkstra on out-edges from a until b is settled; 0 if b
+ * cannot be reached */
+static int search(OVERLAY *ov, int a, int b) {
+  GRAPH *g = ov->g;
+  OV_LEVEL *lv;
+  const dist_t *row;
+  const int *bv, *cell;
+  dist_t du;
+  weight_t w;
+  EDGE_IT it;
+  long nb, j;
+  int u, v, l, c;
+
+  new_search(ov);
+  q_reach(ov, a, 0, a, -1);
+  while(pq_delete_top(ov->q, &u, &du)) {
+    if(u == b) {
+      pq_clear(ov->q);
+      return 1;
+    }
+    l = query_level(ov, u, a, b);
+    if(l >= 0 && ov->lv[l].bidx[u] < 0)
+      l = -1;   // not entered from outside its cell; cannot happen
+    edge_begin(g, u, &it);
+    if(l < 0) {
+      while(edge_next(&it, &v, &w))
+	q_reach(ov, v, dist_add(du, w), u, -1);
+      continue;
+    }
+    lv = &ov->lv[l];
+    cell = ov->p->cell[l];
+    c = cell[u];
+    nb = lv->bstart[c+1] - lv->bstart[c];
+    bv = lv->bv + lv->bstart[c];
+    row = lv->clique + lv->mstart[c] + lv->bidx[u] * nb;
+    // u reached across this very cell: crossing it again from u is
+    //   never shorter than the clique step that got here
+    for(j = 0; j < nb && ov->slev[u] != l; j++)
+      if(row[j] != DIST_INF && bv[j] != u)
+	q_reach(ov, bv[j], dist_add(du, row[j]), u, l);
+    while(edge_next(&it, &v, &w))
+      if(cell[v] != c)
+	q_reach(ov, v, dist_add(du, w), u, -1);
+  }
+  return 0;
+}
+
+/* appends the vertices after x on the shortest path x to y inside
+ * x's level-l cell */
+static void expand(OVERLAY *ov, int x, int y, int l) {
+  int *cell = ov->p->cell[l], c = cell[x], u, v, start;
+  dist_t du;
+  weight_t w;
+  EDGE_IT it;
+
+  new_search(ov);
+  q_reach(ov, x, 0, x, -1);
+  while(pq_delete_top(ov->q, &u, &du)) {
+    if(u == y)
+      break;
+    edge_begin(ov->g, u, &it);
+    while(edge_next(&it, &v, &w))
+      if(cell[v] == c)
+	q_reach(ov, v, dist_add(du, w), u, -1);
+  }
+  pq_clear(ov->q);
+  if(ov->sstamp[y] != ov->sepoch) {   // clique and edges disagree
+    ivec_push(&ov->path, y);
+    return;
+  }
+  start = ov->path.n;
+  for(v = y; v != x; v = ov->spar[v])
+    ivec_push(&ov->path, v);
+  for(u = start, v = ov->path.n - 1; u < v; u++, v--) {
+    c = ov->path.items[u];
+    ov->path.items[u] = ov->path.items[v];
+    ov->path.items[v] = c;
+  }
+}
+
+/* the lightest edge u -> v */
+static weight_t edge_weight(GRAPH *g, int u, int v) {
+  weight_t w, best = 0;
+  EDGE_IT it;
+  int x, found = 0;
+
+  edge_begin(g, u, &it);
+  while(edge_next(&it, &x, &w))
+    if(x == v && (!found || w < best)) {
+      best = w;
+      found = 1;
+    }
+  return best;
+}
+
+/* report entries along the expanded path, distances summed from s */
+static void fill_report(OVERLAY *ov) {
+  int *p = ov->path.items, i, v, nx;
+
+  for(i = ov->path.n - 2; i >= 0; i--) {
+    v = p[i];
+    nx = p[i+1];
+    if(ov->stamp[v] == ov->epoch)   // zero-weight cycle: keep the later
+      continue;
+    ov->stamp[v] = ov->epoch;
+    ov->pred[v] = nx;
+    ov->d[v] = dist_add(ov->d[nx], edge_weight(ov->g, v, nx));
+  }
+}
+
+static void free_level(OV_LEVEL *lv) {
+  free(lv->bstart);
+  free(lv->bv);
+  free(lv->bidx);
+  free(lv->nstart);
+  free(lv->nodes);
+  free(lv->nidx);
+  free(lv->mstart);
+  free(lv->clique);
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+OVERLAY * g_overlay_create(GRAPH *g, int cell_size, int nlevels) {
+  OVERLAY *ov = calloc(1, sizeof(OVERLAY));
+  long maxsize[MAX_LEVELS], size;
+  int n = g->n, l;
+
+  adj_reverse(g);   // crosses() looks at in-edges
+  if(cell_size <= 0)
+    cell_size = DEFAULT_CELL;
+  if(nlevels <= 0)
+    nlevels = DEFAULT_LEVELS;
+  if(nlevels > MAX_LEVELS)
+    nlevels = MAX_LEVELS;
+  for(l = 0, size = cell_size; l < nlevels; l++, size *= FANOUT)
+    maxsize[l] = size < n ? size : (n > 0 ? n : 1);
+
+  ov->g = g;
+  ov->p = part_build(g, nlevels, maxsize);
+  ov->lv = calloc(nlevels, sizeof(OV_LEVEL));
+  for(l = 0; l < nlevels; l++)
+    build_level(ov, l);
+  ov->id_gen = g->id_gen;
+
+  ov->q = pq_create(n > 0 ? n : 1, 1);
+  ov->sd = malloc(sizeof(dist_t) * (n > 0 ? n : 1));
+  ov->spar = malloc(sizeof(int) * (n > 0 ? n : 1));
+  ov->slev = malloc(n > 0 ? n : 1);
+  ov->sstamp = calloc(n > 0 ? n : 1, sizeof(unsigned));
+  ov->d = malloc(sizeof(dist_t) * (n > 0 ? n : 1));
+  ov->pred = malloc(sizeof(int) * (n > 0 ? n : 1));
+  ov->stamp = calloc(n > 0 ? n : 1, sizeof(unsigned));
+  ov->rpt.g = g;
+  ov->rpt.s = -1;
+  ov->rpt.d = ov->d;
+  ov->rpt.pred = ov->pred;
+  ov->rpt.stamp = ov->stamp;
+  ov->rpt.epoch = 0;
+  ov->rpt.ctx_owned = 1;
+  ov->rpt.df = NULL;
+  ov->rpt.dd = NULL;
+  ov->rpt.map = NULL;
+
+  if(tile_failed(g) || !g_overlay_customize(ov, 0)) {
+    g_overlay_free(ov);
+    return NULL;
+  }
+  return ov;
+}
+
+int g_overlay_customize(OVERLAY *ov, int nthreads) {
+  CUSTOMIZE cz;
+  int l, t, cap = ov->maxnodes > 0 ? ov->maxnodes : 1;
+
+  if(ov->id_gen != ov->g->id_gen) {
+    fprintf(stderr, "error: graph renumbered since the overlay was built\n");
+    return 0;
+  }
+  if(nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if(nthreads <= 0)
+    nthreads = 1;
+  if(ov->g->adj_mode == ADJ_TILED)   // the tile cache is not shared
+    nthreads = 1;
+
+  cz.ov = ov;
+  cz.nthreads = nthreads;
+  cz.done = 0;
+  cz.workers = calloc(nthreads, sizeof(WORKER));
+  pthread_barrier_init(&cz.bar, NULL, nthreads);
+  for(t = 0; t < nthreads; t++) {
+    cz.workers[t].cz = &cz;
+    cz.workers[t].q = pq_create(cap, 1);
+    cz.workers[t].d = malloc(sizeof(dist_t) * cap);
+    cz.workers[t].across = malloc(cap);
+    cz.workers[t].stamp = calloc(cap, sizeof(unsigned));
+    if(t > 0)
+      pthread_create(&cz.workers[t].tid, NULL, worker_main, &cz.workers[t]);
+  }
+
+  // a level needs the cliques of the one below
+  for(l = 0; l < ov->p->nlevels; l++)
+    run_level(&cz, l);
+
+  cz.done = 1;
+  pthread_barrier_wait(&cz.bar);
+  for(t = 0; t < nthreads; t++) {
+    if(t > 0)
+      pthread_join(cz.workers[t].tid, NULL);
+    pq_free(cz.workers[t].q);
+    free(cz.workers[t].d);
+    free(cz.workers[t].across);
+    free(cz.workers[t].stamp);
+  }
+  pthread_barrier_destroy(&cz.bar);
+  free(cz.workers);
+  ov->edge_gen = ov->g->edge_gen;
+  ov->customized = !tile_failed(ov->g);
+  return ov->customized;
+}
+
+PATH_RPT * g_shortest_path_overlay(OVERLAY *ov, char *src, char *target) {
+  GRAPH *g = ov->g;
+  int s, t, i;
+
+  s = g_lookup_id(g, src);
+  if(s == -1) {
+    fprintf(stderr, "error: invalid src for shortest path\n");
+    return NULL;
+  }
+  if((t = g_lookup_id(g, target)) == -1) {
+    fprintf(stderr, "error: invalid target for shortest path\n");
+    return NULL;
+  }
+  if(ov->id_gen != g->id_gen || ov->edge_gen != g->edge_gen ||
+     !ov->customized) {
+    fprintf(stderr, "error: graph changed since the overlay was customized\n");
+    return NULL;
+  }
+
+  if(++ov->epoch == 0) {
+    memset(ov->stamp, 0, sizeof(unsigned) * g->n);
+    ov->epoch = 1;
+  }
+  ov->stamp[s] = ov->epoch;
+  ov->d[s] = 0;
+  ov->pred[s] = s;
+  ov->rpt.s = s;
+  ov->rpt.epoch = ov->epoch;
+  // paths lead to src: search from target along the edges
+  if(t == s || !search(ov, t, s))
+    return tile_failed(g) ? NULL : &ov->rpt;
+
+  ov->hopv.n = 0;
+  ov->hopl.n = 0;
+  for(i = s; i != t; i = ov->spar[i]) {
+    ivec_push(&ov->hopv, i);
+    ivec_push(&ov->hopl, ov->slev[i]);
+  }
+  ov->path.n = 0;
+  ivec_push(&ov->path, t);
+  for(i = ov->hopv.n - 1; i >= 0; i--) {
+    if(ov->hopl.items[i] < 0)
+      ivec_push(&ov->path, ov->hopv.items[i]);
+    else
+      expand(ov, ov->path.items[ov->path.n - 1], ov->hopv.items[i],
+	     ov->hopl.items[i]);
+  }
+  if(tile_failed(g))
+    return NULL;
+  fill_report(ov);
+  return &ov->rpt;
+}
+
+void g_overlay_free(OVERLAY *ov) {
+  int l;
+
+  for(l = 0; l < ov->p->nlevels; l++)
+    free_level(&ov->lv[l]);
+  free(ov->lv);
+  part_free(ov->p);
+  pq_free(ov->q);
+  free(ov->sd);
+  free(ov->spar);
+  free(ov->slev);
+  free(ov->sstamp);
+  free(ov->hopv.items);
+  free(ov->hopl.items);
+  free(ov->path.items);
+  free(ov->d);
+  free(ov->pred);
+  free(ov->stamp);
+  free(ov);
+}
@@ -0,0 +1,197 @@
+/**
+ * Nested vertex partitions, for the engines that precompute per cell
+ *   (the overlay of overlay.c, the regions of arcflags.c).
+ *
+ * Cells are grown breadth first: from the lowest unassigned vertex,
+ *   take unassigned neighbors until the cell holds maxsize vertices.
+ *   Neighboring vertices thus mostly share a cell and few edges are
+ *   cut.  A cell that runs out of room to grow while still under half
+ *   full (hemmed in by earlier cells) is merged into the smallest
+ *   neighboring cell that has room for it.  Level l+1 is grown the
+ *   same way on the graph of level-l cells (weighted by their vertex
+ *   counts, joined where an edge crosses), so every level-l cell lies
+ *   inside one level l+1 cell.
+ *
+ * Edges count in both directions and weights are ignored: the
+ *   partition depends on the graph's shape only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+
+/**** UTILITY FUNCTIONS *******/
+
+/*
+ * cells of the nn nodes of a CSR graph (edges of x: adj[off[x] ..
+ *   off[x+1]-1]) with node weights wt, each of weight <= maxw;
+ *   returns the number of cells
+ */
+static int grow(int nn, const long *off, const int *adj, const int *wt,
+		long maxw, int *cell) {
+  int *queue = malloc(sizeof(int) * (nn > 0 ? nn : 1));
+  long *csize = malloc(sizeof(long) * (nn > 0 ? nn : 1));
+  long size, k;
+  int seed, head, tail, x, y, c, best, nc = 0;
+
+  for(x = 0; x < nn; x++)
+    cell[x] = -1;
+  for(seed = 0; seed < nn; seed++) {
+    if(cell[seed] != -1)
+      continue;
+    head = tail = 0;
+    queue[tail++] = seed;
+    cell[seed] = nc;
+    size = wt[seed];
+    while(head < tail && size < maxw) {
+      x = queue[head++];
+      for(k = off[x]; k < off[x+1]; k++) {
+	y = adj[k];
+	if(cell[y] == -1 && size + wt[y] <= maxw) {
+	  cell[y] = nc;
+	  size += wt[y];
+	  queue[tail++] = y;
+	}
+      }
+    }
+    if(2 * size < maxw) {
+      best = -1;
+      for(head = 0; head < tail; head++) {
+	x = queue[head];
+	for(k = off[x]; k < off[x+1]; k++) {
+	  c = cell[adj[k]];
+	  if(c != -1 && c != nc && csize[c] + size <= maxw &&
+	     (best == -1 || csize[c] < csize[best]))
+	    best = c;
+	}
+      }
+      if(best != -1) {
+	for(head = 0; head < tail; head++)
+	  cell[queue[head]] = best;
+	csize[best] += size;
+	continue;
+      }
+    }
+    csize[nc++] = size;
+  }
+  free(queue);
+  free(csize);
+  return nc;
+}
+
+/* the graph with every edge in both directions, as CSR */
+static void both_ways(GRAPH *g, long **off, int **adj) {
+  EDGE_IT it;
+  weight_t w;
+  long *o = calloc(g->n + 1, sizeof(long));
+  int *a, u, v;
+
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      o[u+1]++;
+      if(g->directed)
+	o[v+1]++;
+    }
+  }
+  for(u = 0; u < g->n; u++)
+    o[u+1] += o[u];
+  a = malloc(sizeof(int) * (o[g->n] > 0 ? o[g->n] : 1));
+  for(u = 0; u < g->n; u++) {
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      a[o[u]++] = v;
+      if(g->directed)
+	a[o[v]++] = u;
+    }
+  }
+  for(u = g->n; u > 0; u--)
+    o[u] = o[u-1];
+  o[0] = 0;
+  *off = o;
+  *adj = a;
+}
+
+/* the graph of the nc cells of cell[], joined by the edges they cut
+ * (once per cut edge); wt: vertices per cell */
+static void quotient(int n, const long *off, const int *adj,
+		     const int *cell, int nc, long **qoff, int **qadj,
+		     int **wt) {
+  long *o = calloc(nc + 1, sizeof(long)), k;
+  int *a, *w = calloc(nc > 0 ? nc : 1, sizeof(int)), u;
+
+  for(u = 0; u < n; u++) {
+    w[cell[u]]++;
+    for(k = off[u]; k < off[u+1]; k++)
+      if(cell[adj[k]] != cell[u])
+	o[cell[u]+1]++;
+  }
+  for(u = 0; u < nc; u++)
+    o[u+1] += o[u];
+  a = malloc(sizeof(int) * (o[nc] > 0 ? o[nc] : 1));
+  for(u = 0; u < n; u++)
+    for(k = off[u]; k < off[u+1]; k++)
+      if(cell[adj[k]] != cell[u])
+	a[o[cell[u]]++] = cell[adj[k]];
+  for(u = nc; u > 0; u--)
+    o[u] = o[u-1];
+  o[0] = 0;
+  *qoff = o;
+  *qadj = a;
+  *wt = w;
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+PARTITION * part_build(GRAPH *g, int nlevels, const long *maxsize) {
+  PARTITION *p = malloc(sizeof(PARTITION));
+  long *off, *qoff, maxw;
+  int *adj, *qadj, *wt, *up, n = g->n, l, v;
+
+  p->nlevels = nlevels;
+  p->ncells = malloc(sizeof(int) * nlevels);
+  p->cell = malloc(sizeof(int*) * nlevels);
+  both_ways(g, &off, &adj);
+  wt = malloc(sizeof(int) * (n > 0 ? n : 1));
+  for(v = 0; v < n; v++)
+    wt[v] = 1;
+  for(l = 0; l < nlevels; l++) {
+    maxw = maxsize[l];
+    if(l > 0 && maxw < maxsize[l-1])
+      maxw = maxsize[l-1];
+    p->cell[l] = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if(l == 0) {
+      p->ncells[0] = grow(n, off, adj, wt, maxw, p->cell[0]);
+      continue;
+    }
+    free(wt);
+    quotient(n, off, adj, p->cell[l-1], p->ncells[l-1], &qoff, &qadj, &wt);
+    up = malloc(sizeof(int) * (p->ncells[l-1] > 0 ? p->ncells[l-1] : 1));
+    p->ncells[l] = grow(p->ncells[l-1], qoff, qadj, wt, maxw, up);
+    for(v = 0; v < n; v++)
+      p->cell[l][v] = up[p->cell[l-1][v]];
+    free(up);
+    free(qoff);
+    free(qadj);
+  }
+  free(wt);
+  free(off);
+  free(adj);
+  return p;
+}
+
+void part_free(PARTITION *p) {
+  int l;
+
+  for(l = 0; l < p->nlevels; l++)
+    free(p->cell[l]);
+  free(p->cell);
+  free(p->ncells);
+  free(p);
+}
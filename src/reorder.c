@@ -0,0 +1,257 @@
+/**
+ * Vertex reordering for cache locality.
+ *
+ * Vertices are numbered in the order the loader first sees their
+ *   names, which scatters neighbors over vertices[] and over every
+ *   per-vertex array a search touches (PQ, d, pred).  g_reorder
+ *   renumbers them so that neighbors get nearby indices:
+ *
+ *   G_ORDER_BFS      breadth-first order, one component after another
+ *   G_ORDER_RCM      reverse Cuthill-McKee: BFS from a low degree
+ *                    vertex visiting neighbors by increasing degree,
+ *                    reversed; keeps the bandwidth small
+ *   G_ORDER_HILBERT  position along a Hilbert curve through the
+ *                    coordinates given to g_set_coords
+ *
+ * Only indices into vertices[] change.  The ids clients see stay
+ *   the load-time ids, translated through ext2int/int2ext.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define HILBERT_BITS 16
+
+typedef struct {
+  unsigned long long key;
+  int v;
+} KEYED;
+
+static int cmp_keyed(const void *a, const void *b) {
+  const KEYED *x = a, *y = b;
+  if(x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return x->v - y->v;
+}
+
+/*
+ * Moves vertex order[k] to index k: permutes vertices[] and coords,
+ *   rewrites neighbor ids, the name index and the id maps.
+ */
+/* 0 (g unchanged) if the edges of a tiled g could not be read */
+static int renumber(GRAPH *g, int *order) {
+  int n = g->n, k, u, e;
+  int *newid = malloc(sizeof(int) * n);
+  VERTEX *nv = malloc(sizeof(VERTEX) * n);
+  EDGE_REC *edges = NULL;
+  long *start;
+  LST_NODE *p;
+
+  for(k = 0; k < n; k++)
+    newid[order[k]] = k;
+  // arrays are laid out by index: rebuild them in the new order
+  if(g->adj_mode != ADJ_LIST &&
+     (edges = adj_flatten(g, order, newid, &start)) == NULL) {
+    free(newid);
+    free(nv);
+    return 0;
+  }
+  for(k = 0; k < n; k++) {
+    nv[k] = g->vertices[order[k]];
+    nv[k].id = k;
+    for(p = nv[k].neighbors; p != NULL; p = p->next)
+      p->id = newid[p->id];
+  }
+  free(g->vertices);
+  g->vertices = nv;
+  if(edges != NULL) {
+    if(g->adj_mode == ADJ_PACKED)
+      adj_pack(g, edges, start, g->pk->wfmt);
+    else
+      adj_csr(g, edges, start);
+    free(edges);
+    free(start);
+  }
+
+  if(g->nameidx != NULL)
+    for(k = 0; k < mphf_size(g->nameidx); k++)
+      g->mph2id[k] = newid[g->mph2id[k]];
+
+  if(g->coords != NULL) {
+    double *c = malloc(sizeof(double) * 2 * n);
+    for(k = 0; k < n; k++) {
+      c[2*k] = g->coords[2*order[k]];
+      c[2*k+1] = g->coords[2*order[k]+1];
+    }
+    free(g->coords);
+    g->coords = c;
+  }
+
+  if(g->int2ext == NULL) {
+    g->int2ext = malloc(sizeof(int) * n);
+    g->ext2int = malloc(sizeof(int) * n);
+    for(u = 0; u < n; u++)
+      g->int2ext[u] = u;
+  }
+  for(k = 0; k < n; k++) {
+    e = g->int2ext[order[k]];
+    g->ext2int[e] = k;
+  }
+  for(e = 0; e < n; e++)
+    g->int2ext[g->ext2int[e]] = e;
+
+  // hashes and the reverse adjacency are in terms of the old
+  //   indices; the name view is by external id and the names did
+  //   not move, so pointers handed out by g_get_names_v stay good
+  g->vhash_valid = 0;
+  g->edge_gen++;
+  g->id_gen++;
+  adj_drop_derived(g);
+  free(newid);
+  return 1;
+}
+
+/*
+ * Breadth-first order over all components.  With rcm set, components
+ *   start at a minimum degree vertex, neighbors are visited by
+ *   increasing degree and the final order is reversed.
+ */
+static void bfs_order(GRAPH *g, int *order, int rcm) {
+  int n = g->n, head, tail, i, k, u, nnb;
+  char *seen = calloc(n, 1);
+  KEYED *starts = malloc(sizeof(KEYED) * n);
+  KEYED *nb = NULL;
+  int nbcap = 0, v;
+  weight_t w;
+  EDGE_IT it;
+
+  for(u = 0; u < n; u++) {
+    starts[u].key = rcm ? (unsigned long long)g->vertices[u].out_degree : 0;
+    starts[u].v = u;
+  }
+  if(rcm)
+    qsort(starts, n, sizeof(KEYED), cmp_keyed);
+
+  tail = 0;
+  for(i = 0; i < n; i++) {
+    if(seen[starts[i].v])
+      continue;
+    head = tail;
+    order[tail++] = starts[i].v;
+    seen[starts[i].v] = 1;
+    while(head < tail) {
+      u = order[head++];
+      nnb = 0;
+      if(g->vertices[u].out_degree > nbcap) {
+	nbcap = g->vertices[u].out_degree;
+	nb = realloc(nb, sizeof(KEYED) * nbcap);
+      }
+      edge_begin(g, u, &it);
+      while(edge_next(&it, &v, &w)) {
+	if(!seen[v]) {
+	  seen[v] = 1;
+	  nb[nnb].key = rcm ? (unsigned long long)g->vertices[v].out_degree : 0;
+	  nb[nnb++].v = v;
+	}
+      }
+      if(rcm && nnb > 1)
+	qsort(nb, nnb, sizeof(KEYED), cmp_keyed);
+      for(k = 0; k < nnb; k++)
+	order[tail++] = nb[k].v;
+    }
+  }
+  if(rcm)
+    for(i = 0, k = n - 1; i < k; i++, k--) {
+      u = order[i];
+      order[i] = order[k];
+      order[k] = u;
+    }
+  free(nb);
+  free(starts);
+  free(seen);
+}
+
+/* distance of (x, y) along the Hilbert curve filling the 2^16 grid */
+static unsigned long long hilbert_index(unsigned x, unsigned y) {
+  unsigned long long d = 0;
+  unsigned s, rx, ry, t, side = 1u << HILBERT_BITS;
+
+  for(s = side / 2; s > 0; s /= 2) {
+    rx = (x & s) > 0;
+    ry = (y & s) > 0;
+    d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+    if(ry == 0) {
+      if(rx == 1) {
+	x = side - 1 - x;
+	y = side - 1 - y;
+      }
+      t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+static void hilbert_order(GRAPH *g, int *order) {
+  int n = g->n, u;
+  double minx, maxx, miny, maxy, sx, sy;
+  KEYED *keys = malloc(sizeof(KEYED) * n);
+  double *c = g->coords;
+
+  minx = maxx = c[0];
+  miny = maxy = c[1];
+  for(u = 1; u < n; u++) {
+    if(c[2*u] < minx) minx = c[2*u];
+    if(c[2*u] > maxx) maxx = c[2*u];
+    if(c[2*u+1] < miny) miny = c[2*u+1];
+    if(c[2*u+1] > maxy) maxy = c[2*u+1];
+  }
+  sx = maxx > minx ? ((1u << HILBERT_BITS) - 1) / (maxx - minx) : 0;
+  sy = maxy > miny ? ((1u << HILBERT_BITS) - 1) / (maxy - miny) : 0;
+  for(u = 0; u < n; u++) {
+    keys[u].key = hilbert_index((unsigned)((c[2*u] - minx) * sx),
+				(unsigned)((c[2*u+1] - miny) * sy));
+    keys[u].v = u;
+  }
+  qsort(keys, n, sizeof(KEYED), cmp_keyed);
+  for(u = 0; u < n; u++)
+    order[u] = keys[u].v;
+  free(keys);
+}
+
+void g_set_coords(GRAPH *g, double *x, double *y) {
+  int e, u;
+
+  if(g->coords == NULL)
+    g->coords = malloc(sizeof(double) * 2 * g->n);
+  for(e = 0; e < g->n; e++) {
+    u = g_int_id(g, e);
+    g->coords[2*u] = x[e];
+    g->coords[2*u+1] = y[e];
+  }
+}
+
+int g_reorder(GRAPH *g, int method) {
+  int *order, ok;
+
+  if(method != G_ORDER_BFS && method != G_ORDER_RCM && method != G_ORDER_HILBERT)
+    return 0;
+  if(method == G_ORDER_HILBERT && g->coords == NULL) {
+    fprintf(stderr, "error: hilbert order needs coordinates\n");
+    return 0;
+  }
+  order = malloc(sizeof(int) * g->n);
+  if(method == G_ORDER_HILBERT)
+    hilbert_order(g, order);
+  else
+    bfs_order(g, order, method == G_ORDER_RCM);
+  // the order was read from the edges too: drop it if a tile failed
+  ok = !tile_failed(g) && renumber(g, order);
+  free(order);
+  return ok;
+}
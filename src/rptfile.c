@@ -0,0 +1,154 @@
+/**
+ * Saving and loading PATH_RPTs.
+ *
+ * File layout (native byte order, all offsets 8-byte aligned):
+ *
+ *   RPT_HDR
+ *   int32 pred[n]          padded to a multiple of 8 bytes
+ *   float d[n] | double d[n]
+ *
+ * Unreached vertices have pred -1 and d +inf (float) or DBL_MAX.
+ *   rpt_load maps the file and points the report straight into the
+ *   mapping, so loading costs no more than the page faults of the
+ *   entries actually read.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define RPT_MAGIC "PATHRPT"
+#define RPT_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t dsize;        // sizeof the stored d entries: 4 or 8
+  int32_t n;
+  int32_t s;
+  uint64_t ghash;        // g_version_hash of the graph
+} RPT_HDR;
+
+static size_t pred_bytes(int n) {
+  return ((size_t)n * sizeof(int32_t) + 7) & ~(size_t)7;
+}
+
+int rpt_save(PATH_RPT *r, const char *path, int use_float) {
+  RPT_HDR h;
+  FILE *fp;
+  char *tmp;
+  int n = r->g->n, v, ok;
+  static const char pad[8];
+
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, RPT_MAGIC);
+  h.version = RPT_VERSION;
+  h.dsize = use_float ? sizeof(float) : sizeof(double);
+  h.n = n;
+  h.s = r->s;
+  h.ghash = g_version_hash(r->g);
+
+  // write next to the target and rename, so readers never see half a file
+  tmp = malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+  if((fp = fopen(tmp, "wb")) == NULL) {
+    fprintf(stderr, "error: cannot write %s\n", tmp);
+    free(tmp);
+    return 0;
+  }
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  for(v = 0; v < n && ok; v++) {
+    int32_t p = rpt_pred(r, v);
+    ok = fwrite(&p, sizeof(p), 1, fp) == 1;
+  }
+  if(ok && pred_bytes(n) > (size_t)n * sizeof(int32_t))
+    ok = fwrite(pad, pred_bytes(n) - (size_t)n * sizeof(int32_t), 1, fp) == 1;
+  for(v = 0; v < n && ok; v++) {
+    double d = rpt_d(r, v);
+    if(use_float) {
+      float f = d == DBL_MAX ? INFINITY : (float)d;
+      ok = fwrite(&f, sizeof(f), 1, fp) == 1;
+    }
+    else
+      ok = fwrite(&d, sizeof(d), 1, fp) == 1;
+  }
+  if(fclose(fp) != 0)
+    ok = 0;
+  if(ok && rename(tmp, path) != 0)
+    ok = 0;
+  if(!ok) {
+    fprintf(stderr, "error: cannot write %s\n", path);
+    remove(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+PATH_RPT * rpt_load(GRAPH *g, const char *path) {
+  struct stat st;
+  RPT_HDR *h;
+  PATH_RPT *r;
+  char *map;
+  size_t len;
+  int fd;
+
+  if((fd = open(path, O_RDONLY)) < 0) {
+    fprintf(stderr, "error: cannot open %s\n", path);
+    return NULL;
+  }
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RPT_HDR)) {
+    fprintf(stderr, "error: %s is not a path report\n", path);
+    close(fd);
+    return NULL;
+  }
+  len = st.st_size;
+  map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    fprintf(stderr, "error: cannot map %s\n", path);
+    return NULL;
+  }
+
+  h = (RPT_HDR*)map;
+  if(memcmp(h->magic, RPT_MAGIC, sizeof(RPT_MAGIC)) != 0
+     || h->version != RPT_VERSION
+     || (h->dsize != sizeof(float) && h->dsize != sizeof(double))
+     || h->n != g->n || h->s < 0 || h->s >= g->n
+     || len != sizeof(RPT_HDR) + pred_bytes(h->n) + (size_t)h->n * h->dsize) {
+    fprintf(stderr, "error: %s is not a path report for this graph\n", path);
+    munmap(map, len);
+    return NULL;
+  }
+  if(h->ghash != g_version_hash(g)) {
+    fprintf(stderr, "error: %s was computed for another version of the graph\n", path);
+    munmap(map, len);
+    return NULL;
+  }
+
+  r = malloc(sizeof(PATH_RPT));
+  r->g = g;
+  r->s = h->s;
+  r->pred = (int*)(map + sizeof(RPT_HDR));
+  r->d = NULL;
+  r->df = NULL;
+  r->dd = NULL;
+  if(h->dsize == sizeof(float))
+    r->df = (float*)(map + sizeof(RPT_HDR) + pred_bytes(h->n));
+  else
+    r->dd = (double*)(map + sizeof(RPT_HDR) + pred_bytes(h->n));
+  r->stamp = NULL;
+  r->epoch = 0;
+  r->ctx_owned = 0;
+  r->map = map;
+  r->maplen = len;
+  return r;
+}
@@ -0,0 +1,627 @@
+/**
+ * Graph simplification passes, run once after loading.
+ *
+ * g_collapse_multi_edges keeps, for every pair of vertices joined by
+ *   several edges, only the lightest one.  A vertex's duplicates are
+ *   found with a per-neighbor mark (owner[v] == u while scanning u's
+ *   edges, at[v] where that edge was kept), so the pass is linear in
+ *   the number of edges and needs no sorting.  The kept edge stays
+ *   where the first of its copies was.
+ *
+ * g_contract_chains removes the interior vertices of degree-2 chains
+ *   from the search.  A chain a - x1 - ... - xk - b between two other
+ *   vertices becomes a shortcut a - b of the chain's length in a
+ *   separate core adjacency (the graph's own adjacency is untouched).
+ *   g_shortest_path then runs Dijkstra on the core only and fills in
+ *   each xj afterwards from the nearer of d[a] + (a to xj) and
+ *   d[b] + (xj to b), with pred along the chain, so the report covers
+ *   every vertex and rpt_path gives full vertex sequences.  A source
+ *   inside a chain seeds a and b and also reaches its chain directly.
+ *   Rings of degree-2 vertices with no other vertex on them stay in
+ *   the core as they are.
+ *
+ * g_peel_fringe removes the trees hanging off the graph (the 1-shell):
+ *   leaves are peeled repeatedly, each remembering the neighbor it
+ *   hung from, until only the 2-core (and one root per component that
+ *   is a tree) is left.  A search runs Dijkstra on the core and gives
+ *   every peeled vertex d[parent] + its edge, parents first.  A source
+ *   in a tree first walks its parent pointers up to the attachment
+ *   vertex; the vertices on that walk point back down towards it.
+ *
+ * Both keep the graph's adjacency and build a separate, smaller one
+ *   for the search; a graph has one or the other, not both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "pq.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+/* what the search sees: edges of core vertex u are adj/w[off[u] ..
+ * off[u+1]-1]; via[i] is the chain edge i stands for, -1 if none */
+typedef struct {
+  long *off;
+  int *adj;
+  dist_t *w;
+  int *via;
+} CORE_ADJ;
+
+struct chains {
+  int nchains;
+  int *ca;          // chain c runs from ca[c] to cb[c] ...
+  int *cb;
+  dist_t *clen;     //   and is clen[c] long
+  long *cstart;     // its interior vertices in order from ca[c]:
+  int *cv;          //   cv[cstart[c] .. cstart[c+1]-1]
+  dist_t *coff;     // distance from ca[c] to cv[i]
+  int *vchain;      // chain of an interior vertex, -1 for core ones
+  long *vpos;       // index of an interior vertex in cv
+  CORE_ADJ core;
+  int ninterior;
+};
+
+struct fringe {
+  int *parent;      // peeled vertex -> neighbor it hung from; -1 for
+  dist_t *pw;       //   core vertices.  pw: weight of that edge
+  int *order;       // peeled vertices, in the order they were peeled
+  int npeeled;
+  CORE_ADJ core;
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static long collapse_list(GRAPH *g, int *owner, LST_NODE **kept) {
+  LST_NODE *p, *next, **link;
+  long removed = 0;
+  int u, v;
+
+  for(u = 0; u < g->n; u++) {
+    link = &g->vertices[u].neighbors;
+    for(p = *link; p != NULL; p = next) {
+      next = p->next;
+      v = p->id;
+      if(owner[v] != u) {
+	owner[v] = u;
+	kept[v] = p;
+	link = &p->next;
+	continue;
+      }
+      if(p->weight < kept[v]->weight)
+	kept[v]->weight = p->weight;
+      *link = next;
+      free(p);
+      g->vertices[u].out_degree--;
+      removed++;
+    }
+  }
+  return removed;
+}
+
+/* compacts the CSR arrays in place */
+static long collapse_csr(GRAPH *g, int *owner, long *at) {
+  long i, k, lo, hi;
+  int u, v;
+
+  for(u = 0, k = 0, lo = 0; u < g->n; u++) {
+    hi = g->csr_off[u+1];
+    g->csr_off[u] = k;
+    for(i = lo; i < hi; i++) {
+      v = g->csr_adj[i];
+      if(owner[v] != u) {
+	owner[v] = u;
+	at[v] = k;
+	g->csr_adj[k] = v;
+	g->csr_w[k++] = g->csr_w[i];
+      }
+      else if(g->csr_w[i] < g->csr_w[at[v]])
+	g->csr_w[at[v]] = g->csr_w[i];
+    }
+    g->vertices[u].out_degree = k - g->csr_off[u];
+    lo = hi;
+  }
+  g->csr_off[g->n] = k;
+  return lo - k;
+}
+
+/* on the flattened edges, then stores them again (tiled graphs end
+ * up as CSR in memory) */
+static long collapse_flat(GRAPH *g, int *owner, long *at) {
+  EDGE_REC *e;
+  long *start, i, k, lo, m;
+  int u, v;
+
+  if((e = adj_flatten(g, NULL, NULL, &start)) == NULL)
+    return -1;
+  m = start[g->n];
+  for(u = 0, k = 0, lo = 0; u < g->n; u++) {
+    for(i = lo; i < start[u+1]; i++) {
+      v = e[i].v;
+      if(owner[v] != u) {
+	owner[v] = u;
+	at[v] = k;
+	e[k++] = e[i];
+      }
+      else if(e[i].w < e[at[v]].w)
+	e[at[v]].w = e[i].w;
+    }
+    lo = start[u+1];
+    start[u+1] = k;
+  }
+  if(g->adj_mode == ADJ_PACKED)
+    adj_pack(g, e, start, g->pk->wfmt);
+  else
+    adj_csr(g, e, start);
+  free(e);
+  free(start);
+  return m - k;
+}
+
+/* two distinct neighbors and no other edge */
+static int is_interior(GRAPH *g, int u, int *nb, weight_t *nw) {
+  EDGE_IT it;
+  weight_t w;
+  int v, k = 0;
+
+  if(g->vertices[u].out_degree != 2)
+    return 0;
+  edge_begin(g, u, &it);
+  while(edge_next(&it, &v, &w)) {
+    nb[k] = v;
+    nw[k++] = w;
+  }
+  return k == 2 && nb[0] != nb[1];   // fewer if a tile failed
+}
+
+/* weight of the edge between interior x and its neighbor v */
+static weight_t chain_w(int *nb, weight_t *nw, int x, int v) {
+  return nb[2*x] == v ? nw[2*x] : nw[2*x+1];
+}
+
+/* the chain from core vertex a through interior x */
+static void walk_chain(CHAINS *ch, int *nb, weight_t *nw, int a, int x) {
+  int c = ch->nchains++, prev = a, next;
+  long i = ch->cstart[c];
+  dist_t acc = 0;
+
+  ch->ca[c] = a;
+  while(ch->vchain[x] == -2) {
+    acc = dist_add(acc, chain_w(nb, nw, x, prev));
+    ch->cv[i] = x;
+    ch->coff[i] = acc;
+    ch->vchain[x] = c;
+    ch->vpos[x] = i++;
+    next = nb[2*x] == prev ? nb[2*x+1] : nb[2*x];
+    prev = x;
+    x = next;
+  }
+  ch->cb[c] = x;
+  ch->clen[c] = dist_add(acc, chain_w(nb, nw, prev, x));
+  ch->cstart[c+1] = i;
+}
+
+/* far end of the chain of interior x seen from its end u; -1 if the
+ * chain comes back to u */
+static int chain_end(CHAINS *ch, int u, int x) {
+  int c = ch->vchain[x];
+
+  if(ch->ca[c] == ch->cb[c])
+    return -1;
+  return ch->ca[c] == u ? ch->cb[c] : ch->ca[c];
+}
+
+/* the core adjacency: core-to-core edges plus one shortcut per chain
+ * end */
+static void build_core(GRAPH *g, CHAINS *ch) {
+  CORE_ADJ *c = &ch->core;
+  EDGE_IT it;
+  weight_t w;
+  long k;
+  int u, v, e;
+
+  c->off = malloc(sizeof(long) * (g->n + 1));
+  for(u = 0, k = 0; u < g->n; u++) {
+    c->off[u] = k;
+    if(ch->vchain[u] >= 0)
+      continue;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      k += ch->vchain[v] < 0 || chain_end(ch, u, v) >= 0;
+  }
+  c->off[g->n] = k;
+  c->adj = malloc(sizeof(int) * (k > 0 ? k : 1));
+  c->w = malloc(sizeof(dist_t) * (k > 0 ? k : 1));
+  c->via = malloc(sizeof(int) * (k > 0 ? k : 1));
+  for(u = 0, k = 0; u < g->n; u++) {
+    if(ch->vchain[u] >= 0)
+      continue;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w)) {
+      if(ch->vchain[v] < 0) {
+	c->adj[k] = v;
+	c->w[k] = w;
+	c->via[k++] = -1;
+      }
+      else if((e = chain_end(ch, u, v)) >= 0) {
+	c->adj[k] = e;
+	c->w[k] = ch->clen[ch->vchain[v]];
+	c->via[k++] = ch->vchain[v];
+      }
+    }
+  }
+}
+
+/* the interior vertex of chain c next to its end e */
+static int chain_next_to(CHAINS *ch, int c, int e) {
+  return e == ch->ca[c] ? ch->cv[ch->cstart[c]] : ch->cv[ch->cstart[c+1]-1];
+}
+
+/* d[v] = dv, pred[v] = p if that is shorter */
+static void offer(dist_t *d, int *pred, int v, dist_t dv, int p) {
+  if(dv < d[v]) {
+    d[v] = dv;
+    pred[v] = p;
+  }
+}
+
+/* d and pred of the interior vertices of chain c, from its ends */
+static void fill_chain(CHAINS *ch, int c, dist_t *d, int *pred, int s) {
+  long lo = ch->cstart[c], hi = ch->cstart[c+1], i, k;
+  int a = ch->ca[c], b = ch->cb[c];
+
+  if(ch->vchain[s] == c) {
+    // straight along the chain from s first
+    k = ch->vpos[s];
+    d[s] = 0;
+    pred[s] = s;
+    for(i = k - 1; i >= lo; i--)
+      offer(d, pred, ch->cv[i], ch->coff[k] - ch->coff[i], ch->cv[i+1]);
+    for(i = k + 1; i < hi; i++)
+      offer(d, pred, ch->cv[i], ch->coff[i] - ch->coff[k], ch->cv[i-1]);
+  }
+  for(i = lo; i < hi; i++) {
+    if(d[a] < DIST_INF)
+      offer(d, pred, ch->cv[i], dist_add(d[a], ch->coff[i]),
+	    i == lo ? a : ch->cv[i-1]);
+    if(d[b] < DIST_INF)
+      offer(d, pred, ch->cv[i], dist_add(d[b], ch->clen[c] - ch->coff[i]),
+	    i == hi - 1 ? b : ch->cv[i+1]);
+  }
+}
+
+static void core_free(CORE_ADJ *c) {
+  free(c->off);
+  free(c->adj);
+  free(c->w);
+  free(c->via);
+}
+
+/*
+ * Dijkstra on c from the vertices already in q (with d and pred set,
+ *   DIST_INF elsewhere).  A chain edge makes pred the chain's last
+ *   interior vertex, which fill_chain then links up.
+ */
+static void core_dijkstra(CORE_ADJ *c, CHAINS *ch, PQ *q, dist_t *d,
+			  int *pred) {
+  dist_t du, dv;
+  long i;
+  int u, v;
+
+  while(pq_delete_top(q, &u, &du)) {
+    for(i = c->off[u]; i < c->off[u+1]; i++) {
+      v = c->adj[i];
+      dv = dist_add(du, c->w[i]);
+      if(d[v] == DIST_INF) {
+	d[v] = dv;
+	pq_insert(q, v, dv);
+      }
+      else if(dv < d[v] && pq_contains(q, v)) {
+	d[v] = dv;
+	pq_change_priority(q, v, dv);
+      }
+      else
+	continue;
+      pred[v] = c->via[i] < 0 ? u : chain_next_to(ch, c->via[i], v);
+    }
+  }
+}
+
+/* distinct neighbors of every vertex */
+static void count_distinct(GRAPH *g, int *deg) {
+  int *owner = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  EDGE_IT it;
+  weight_t w;
+  int u, v;
+
+  for(v = 0; v < g->n; v++)
+    owner[v] = -1;
+  for(u = 0; u < g->n; u++) {
+    deg[u] = 0;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      if(owner[v] != u) {
+	owner[v] = u;
+	deg[u]++;
+      }
+  }
+  free(owner);
+}
+
+/* the edges between unpeeled vertices */
+static void build_fringe_core(GRAPH *g, FRINGE *f) {
+  CORE_ADJ *c = &f->core;
+  EDGE_IT it;
+  weight_t w;
+  long k;
+  int u, v, pass;
+
+  c->off = malloc(sizeof(long) * (g->n + 1));
+  c->adj = NULL;
+  for(pass = 0; pass < 2; pass++) {
+    for(u = 0, k = 0; u < g->n; u++) {
+      c->off[u] = k;
+      if(f->parent[u] >= 0)
+	continue;
+      edge_begin(g, u, &it);
+      while(edge_next(&it, &v, &w)) {
+	if(f->parent[v] >= 0)
+	  continue;
+	if(pass == 1) {
+	  c->adj[k] = v;
+	  c->w[k] = w;
+	  c->via[k] = -1;
+	}
+	k++;
+      }
+    }
+    c->off[g->n] = k;
+    if(pass == 0) {
+      c->adj = malloc(sizeof(int) * (k > 0 ? k : 1));
+      c->w = malloc(sizeof(dist_t) * (k > 0 ? k : 1));
+      c->via = malloc(sizeof(int) * (k > 0 ? k : 1));
+    }
+  }
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+long g_collapse_multi_edges(GRAPH *g) {
+  int *owner = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  long removed;
+  void *at;
+  int v;
+
+  for(v = 0; v < g->n; v++)
+    owner[v] = -1;
+  at = malloc((g->adj_mode == ADJ_LIST ? sizeof(LST_NODE*) : sizeof(long))
+	      * (g->n > 0 ? g->n : 1));
+  if(g->adj_mode == ADJ_LIST)
+    removed = collapse_list(g, owner, at);
+  else if(g->adj_mode == ADJ_CSR)
+    removed = collapse_csr(g, owner, at);
+  else
+    removed = collapse_flat(g, owner, at);
+  free(owner);
+  free(at);
+  if(removed < 0)
+    return -1;
+  if(removed > 0) {
+    g->vhash_valid = 0;
+    g->edge_gen++;
+    adj_drop_derived(g);
+  }
+  // an undirected edge is stored at both ends
+  return g->directed ? removed : removed / 2;
+}
+
+
+
+int g_contract_chains(GRAPH *g) {
+  CHAINS *ch;
+  EDGE_IT it;
+  weight_t *nw, w;
+  int *nb, u, v, k;
+
+  if(g->directed)
+    return -1;
+  adj_drop_derived(g);
+  ch = calloc(1, sizeof(CHAINS));
+  nb = malloc(sizeof(int) * 2 * (g->n > 0 ? g->n : 1));
+  nw = malloc(sizeof(weight_t) * 2 * (g->n > 0 ? g->n : 1));
+  ch->vchain = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  ch->vpos = malloc(sizeof(long) * (g->n > 0 ? g->n : 1));
+  // -2 marks an interior vertex not yet on a chain
+  for(u = 0, k = 0; u < g->n; u++) {
+    ch->vchain[u] = is_interior(g, u, nb + 2*u, nw + 2*u) ? -2 : -1;
+    k += ch->vchain[u] == -2;
+  }
+  // at most one chain per interior vertex
+  ch->ca = malloc(sizeof(int) * (k > 0 ? k : 1));
+  ch->cb = malloc(sizeof(int) * (k > 0 ? k : 1));
+  ch->clen = malloc(sizeof(dist_t) * (k > 0 ? k : 1));
+  ch->cstart = calloc(k + 1, sizeof(long));
+  ch->cv = malloc(sizeof(int) * (k > 0 ? k : 1));
+  ch->coff = malloc(sizeof(dist_t) * (k > 0 ? k : 1));
+  for(u = 0; u < g->n; u++) {
+    if(ch->vchain[u] != -1)
+      continue;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      if(ch->vchain[v] == -2)
+	walk_chain(ch, nb, nw, u, v);
+  }
+  // rings without a core vertex
+  for(u = 0; u < g->n; u++)
+    if(ch->vchain[u] == -2)
+      ch->vchain[u] = -1;
+  ch->ninterior = ch->cstart[ch->nchains];
+  free(nb);
+  free(nw);
+  build_core(g, ch);
+  if(tile_failed(g)) {
+    chains_free(ch);
+    return -1;
+  }
+  g->chains = ch;
+  return ch->ninterior;
+}
+
+void chains_free(CHAINS *ch) {
+  free(ch->ca);
+  free(ch->cb);
+  free(ch->clen);
+  free(ch->cstart);
+  free(ch->cv);
+  free(ch->coff);
+  free(ch->vchain);
+  free(ch->vpos);
+  core_free(&ch->core);
+  free(ch);
+}
+
+PATH_RPT * chains_shortest_path(GRAPH *g, int s) {
+  CHAINS *ch = g->chains;
+  PATH_RPT *ret = create_dijk_rpt(g, s, g->n);
+  dist_t *d = ret->d, dv;
+  int *pred = ret->pred, v, c;
+  PQ *q;
+  long i;
+
+  for(v = 0; v < g->n; v++) {
+    d[v] = DIST_INF;
+    pred[v] = -1;
+  }
+  q = pq_create(g->n, 1);
+  if((c = ch->vchain[s]) >= 0) {
+    // leave the chain through either end
+    i = ch->vpos[s];
+    d[ch->ca[c]] = ch->coff[i];
+    pred[ch->ca[c]] = chain_next_to(ch, c, ch->ca[c]);
+    pq_insert(q, ch->ca[c], d[ch->ca[c]]);
+    dv = ch->clen[c] - ch->coff[i];
+    if(dv < d[ch->cb[c]]) {
+      if(d[ch->cb[c]] == DIST_INF)
+	pq_insert(q, ch->cb[c], dv);
+      else
+	pq_change_priority(q, ch->cb[c], dv);
+      d[ch->cb[c]] = dv;
+      pred[ch->cb[c]] = chain_next_to(ch, c, ch->cb[c]);
+    }
+  }
+  else {
+    d[s] = 0;
+    pred[s] = s;
+    pq_insert(q, s, 0);
+  }
+
+  core_dijkstra(&ch->core, ch, q, d, pred);
+  pq_free(q);
+
+  for(c = 0; c < ch->nchains; c++)
+    fill_chain(ch, c, d, pred, s);
+  return ret;
+}
+
+int g_peel_fringe(GRAPH *g) {
+  FRINGE *f;
+  EDGE_IT it;
+  weight_t w;
+  int *deg, *queue, head, tail, u, v, p;
+  dist_t pw;
+
+  if(g->directed)
+    return -1;
+  adj_drop_derived(g);
+  f = malloc(sizeof(FRINGE));
+  f->parent = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  f->pw = malloc(sizeof(dist_t) * (g->n > 0 ? g->n : 1));
+  f->order = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  f->npeeled = 0;
+  deg = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  queue = malloc(sizeof(int) * (g->n > 0 ? g->n : 1));
+  count_distinct(g, deg);
+  for(u = 0, tail = 0; u < g->n; u++) {
+    f->parent[u] = -1;
+    if(deg[u] == 1)
+      queue[tail++] = u;
+  }
+  // deg counts unpeeled neighbors.  A vertex reaches 1 at most once;
+  //   one that drops to 0 is the last of a tree and stays as its root
+  for(head = 0; head < tail; head++) {
+    u = queue[head];
+    if(deg[u] != 1)
+      continue;
+    p = -1;
+    pw = DIST_INF;
+    edge_begin(g, u, &it);
+    while(edge_next(&it, &v, &w))
+      if(f->parent[v] < 0 && v != u && w < pw) {
+	p = v;
+	pw = w;
+      }
+    f->parent[u] = p;
+    f->pw[u] = pw;
+    f->order[f->npeeled++] = u;
+    deg[u] = 0;
+    if(p >= 0 && --deg[p] == 1)   // p < 0 only if a tile failed
+      queue[tail++] = p;
+  }
+  free(deg);
+  free(queue);
+  build_fringe_core(g, f);
+  if(tile_failed(g)) {
+    fringe_free(f);
+    return -1;
+  }
+  g->fringe = f;
+  return f->npeeled;
+}
+
+void fringe_free(FRINGE *f) {
+  free(f->parent);
+  free(f->pw);
+  free(f->order);
+  core_free(&f->core);
+  free(f);
+}
+
+PATH_RPT * fringe_shortest_path(GRAPH *g, int s) {
+  FRINGE *f = g->fringe;
+  PATH_RPT *ret = create_dijk_rpt(g, s, g->n);
+  dist_t *d = ret->d;
+  int *pred = ret->pred, u, v, k;
+  PQ *q;
+
+  for(v = 0; v < g->n; v++) {
+    d[v] = DIST_INF;
+    pred[v] = -1;
+  }
+  d[s] = 0;
+  pred[s] = s;
+  // up the tree to the core; these are the only peeled vertices whose
+  //   pred points away from the core
+  for(u = s; f->parent[u] >= 0; u = v) {
+    v = f->parent[u];
+    d[v] = dist_add(d[u], f->pw[u]);
+    pred[v] = u;
+  }
+  q = pq_create(g->n, 1);
+  pq_insert(q, u, d[u]);
+  core_dijkstra(&f->core, NULL, q, d, pred);
+  pq_free(q);
+
+  for(k = f->npeeled - 1; k >= 0; k--) {
+    v = f->order[k];
+    u = f->parent[v];
+    if(d[v] == DIST_INF && d[u] < DIST_INF) {
+      d[v] = dist_add(d[u], f->pw[v]);
+      pred[v] = u;
+    }
+  }
+  return ret;
+}
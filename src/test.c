@@ -0,0 +1,924 @@
+/**
+ * Tests of the graph library.
+ *
+ * usage:  test [seed]
+ *
+ * Generates random graphs, undirected and directed (a random tree
+ *   for dead ends and degree-2 chains, plus random extra edges and
+ *   integer weights), and checks every search engine against
+ *   g_shortest_path on the list graph: the distance of each vertex
+ *   the engine reports, and that its path runs over real edges whose
+ *   weights add up to that distance, one rpt_next_hop at a time.
+ *   Writes its scratch files to the current directory and removes
+ *   them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "graph.h"
+
+#define GRAPH_FILE "test_graph.tmp"
+#define TILE_FILE "test_tiles.tmp"
+#define FLAG_FILE "test_flags.tmp"
+#define RPT_FILE "test_rpt.tmp"
+
+#define NSOURCES 4
+#define NTARGETS 25
+#define NLOOKUP_THREADS 4
+#define NLOOKUPS 50000
+
+/* a generated graph and the reference trees of a few sources */
+typedef struct {
+  GRAPH *g;
+  int directed;
+  int n;
+  const char *src[NSOURCES];
+  PATH_RPT *ref[NSOURCES];
+} CASE;
+
+static int testtotal = 0, testfail = 0;
+
+/**** UTILITY FUNCTIONS *******/
+
+/* n vertices "v0".."v<n-1>": a random tree plus extra random edges */
+static int write_graph(int n, int extra, int directed) {
+  FILE *fp = fopen(GRAPH_FILE, "w");
+  int i, u;
+
+  if(fp == NULL)
+    return 0;
+  fprintf(fp, directed ? "%i directed\n" : "%i\n", n);
+  for(i = 1; i < n; i++) {
+    fprintf(fp, "v%i v%i %i\n", rand() % i, i, 1 + rand() % 9);
+    if(directed)
+      fprintf(fp, "v%i v%i %i\n", i, rand() % i, 1 + rand() % 9);
+  }
+  for(i = 0; i < extra; i++) {
+    u = rand() % n;
+    fprintf(fp, "v%i v%i %i\n", u, (u + 1 + rand() % (n - 1)) % n,
+	    1 + rand() % 9);
+  }
+  fclose(fp);
+  return 1;
+}
+
+static GRAPH * load(void) {
+  FILE *fp = fopen(GRAPH_FILE, "r");
+  GRAPH *g;
+
+  if(fp == NULL)
+    return NULL;
+  g = g_from_stream(fp);
+  fclose(fp);
+  return g;
+}
+
+static int same_dist(double a, double b) {
+  if(a == DBL_MAX || b == DBL_MAX)
+    return a == b;
+  return fabs(a - b) <= 1e-6 * (1 + fabs(a));
+}
+
+/* weight of the lightest edge x -> y of h; -1 if there is none */
+static double edge_w(GRAPH *h, int x, int y) {
+  const char *yn = g_vertex_name(h, y), **names;
+  double *w, best = -1;
+  int deg, k;
+
+  deg = g_get_neighbors_v(h, g_vertex_name(h, x), NULL, NULL, 0);
+  names = malloc(sizeof(char*) * (deg > 0 ? deg : 1));
+  w = malloc(sizeof(double) * (deg > 0 ? deg : 1));
+  g_get_neighbors_v(h, g_vertex_name(h, x), names, w, deg);
+  for(k = 0; k < deg; k++)
+    if(strcmp(names[k], yn) == 0 && (best < 0 || w[k] < best))
+      best = w[k];
+  free(names);
+  free(w);
+  return best;
+}
+
+/*
+ * 1 if the path of v in r (on h, toward s) steps from next hop to
+ *   next hop over edges of h whose weights add up to rpt_dist of v,
+ *   and rpt_path_ids lists the same vertices
+ */
+static int path_ok(GRAPH *h, PATH_RPT *r, int v, int s, int *buf) {
+  double sum = 0, d = rpt_dist(r, v), w;
+  int x, y, k, len;
+
+  if(d == DBL_MAX)
+    return rpt_next_hop(r, v) == -1 && rpt_path_ids(r, v, NULL, 0) == 0;
+  for(x = v, k = 0; x != s; x = y, k++) {
+    if(k >= g_size(h) || (y = rpt_next_hop(r, x)) < 0 ||
+       (w = edge_w(h, x, y)) < 0)
+      return 0;
+    sum += w;
+  }
+  if(rpt_next_hop(r, s) != -1 || !same_dist(sum, d))
+    return 0;
+  if((len = rpt_path_ids(r, v, buf, g_size(h))) != k + 1)
+    return 0;
+  for(x = v, k = 0; k < len; x = rpt_next_hop(r, x), k++)
+    if(buf[k] != x)
+      return 0;
+  return 1;
+}
+
+/*
+ * one test: every vertex of r (on graph h) has ref's distance and a
+ *   path that checks out
+ */
+static void check_tree(const char *engine, CASE *c, int k, GRAPH *h,
+		       PATH_RPT *r) {
+  int *buf = malloc(sizeof(int) * c->n), v, hv, s, bad = 0;
+
+  if(r == NULL)
+    printf("%s from %s: no report\n", engine, c->src[k]);
+  s = g_vertex_id(h, c->src[k]);
+  for(v = 0; r != NULL && v < c->n && !bad; v++) {
+    hv = g_vertex_id(h, g_vertex_name(c->g, v));
+    if(!same_dist(rpt_dist(c->ref[k], v), rpt_dist(r, hv))) {
+      printf("%s from %s: %s at %g, expected %g\n", engine, c->src[k],
+	     g_vertex_name(c->g, v), rpt_dist(r, hv), rpt_dist(c->ref[k], v));
+      bad = 1;
+    }
+    else if(!path_ok(h, r, hv, s, buf)) {
+      printf("%s from %s: bad path from %s\n", engine, c->src[k],
+	     g_vertex_name(c->g, v));
+      bad = 1;
+    }
+  }
+  free(buf);
+  testfail += (r == NULL || bad);
+  testtotal++;
+}
+
+/*
+ * one test: for random targets, the report query(arg, src, target)
+ *   gives target ref's distance and a path that checks out
+ */
+static void check_pairs(const char *engine, CASE *c, int k,
+			PATH_RPT *(*query)(void *, char *, char *),
+			void *arg) {
+  int *buf = malloc(sizeof(int) * c->n), j, t, s, bad = 0;
+  const char *tn;
+  PATH_RPT *r;
+
+  s = g_vertex_id(c->g, c->src[k]);
+  for(j = 0; j < NTARGETS && !bad; j++) {
+    t = rand() % c->n;
+    tn = g_vertex_name(c->g, t);
+    r = query(arg, (char*)c->src[k], (char*)tn);
+    if(r == NULL || !same_dist(rpt_dist(c->ref[k], t), rpt_dist(r, t))) {
+      printf("%s from %s: %s at %g, expected %g\n", engine, c->src[k], tn,
+	     r == NULL ? -1.0 : rpt_dist(r, t), rpt_dist(c->ref[k], t));
+      bad = 1;
+    }
+    else if(!path_ok(c->g, r, t, s, buf)) {
+      printf("%s from %s: bad path from %s\n", engine, c->src[k], tn);
+      bad = 1;
+    }
+  }
+  free(buf);
+  testfail += bad;
+  testtotal++;
+}
+
+/* expected: 0 if the call must fail, 1 if it must succeed */
+static void check_status(const char *what, int ok, int expected) {
+  if(ok != expected)
+    printf("%s: %s\n", what, expected ? "failed" : "accepted");
+  testfail += (ok != expected);
+  testtotal++;
+}
+
+static int cmp_edge(const void *a, const void *b) {
+  const double *x = a, *y = b;
+  return x[0] != y[0] ? (x[0] < y[0] ? -1 : 1) :
+    (x[1] != y[1] ? (x[1] < y[1] ? -1 : 1) : 0);
+}
+
+/* out-edges of v in h as sorted (id in c->g, weight) pairs */
+static int edge_list(CASE *c, GRAPH *h, int v, const char **names,
+		     double *w, double *pairs) {
+  const char *name = g_vertex_name(c->g, v);
+  int k, deg = g_get_neighbors_v(h, name, names, w, c->n * 4);
+
+  for(k = 0; k < deg; k++) {
+    pairs[2*k] = g_vertex_id(c->g, names[k]);
+    pairs[2*k+1] = w[k];
+  }
+  qsort(pairs, deg > 0 ? deg : 0, 2 * sizeof(double), cmp_edge);
+  return deg;
+}
+
+/*
+ * one test: h, loaded another way from the same file, has c->g's
+ *   names, ids and edges; then the distances of every source
+ */
+static void check_same_graph(const char *what, CASE *c, GRAPH *h) {
+  const char **names = malloc(sizeof(char*) * c->n * 4);
+  double *w = malloc(sizeof(double) * c->n * 4);
+  double *a = malloc(sizeof(double) * c->n * 8);
+  double *b = malloc(sizeof(double) * c->n * 8);
+  PATH_RPT *r;
+  int v, k, da, bad;
+
+  bad = h == NULL || g_size(h) != c->n || g_is_directed(h) != c->directed;
+  for(v = 0; !bad && v < c->n; v++) {
+    da = edge_list(c, c->g, v, names, w, a);
+    bad = strcmp(g_vertex_name(h, v), g_vertex_name(c->g, v)) != 0 ||
+      edge_list(c, h, v, names, w, b) != da ||
+      memcmp(a, b, sizeof(double) * 2 * da) != 0;
+    if(bad)
+      printf("%s: %s differs\n", what, g_vertex_name(c->g, v));
+  }
+  check_status(what, !bad, 1);
+  for(k = 0; !bad && k < NSOURCES; k++) {
+    r = g_shortest_path(h, (char*)c->src[k]);
+    check_tree(what, c, k, h, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  free(names);
+  free(w);
+  free(a);
+  free(b);
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+static void test_reference(CASE *c) {
+  int k;
+
+  for(k = 0; k < NSOURCES; k++)
+    check_tree("dijkstra", c, k, c->g, c->ref[k]);
+}
+
+static void test_delta(CASE *c) {
+  PATH_RPT *r;
+  int k;
+
+  for(k = 0; k < NSOURCES; k++) {
+    r = g_shortest_path_delta(c->g, (char*)c->src[k], 0, 3);
+    check_tree("delta-stepping", c, k, c->g, r);
+    if(r != NULL)
+      rpt_free(r);
+    r = g_shortest_path_delta(c->g, (char*)c->src[k], 1, 1);
+    check_tree("delta-stepping, 1 thread", c, k, c->g, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+}
+
+/* the ctx report of a target query, through check_pairs */
+static PATH_RPT * ctx_query(void *ctx, char *src, char *target) {
+  return g_shortest_path_ctx(ctx, src, target);
+}
+
+static void test_ctx(CASE *c) {
+  QUERY_CTX *ctx = g_query_ctx_create(c->g);
+  int k;
+
+  // whole trees and target queries interleaved on one workspace
+  for(k = 0; k < NSOURCES; k++) {
+    check_tree("ctx", c, k, c->g, g_shortest_path_ctx(ctx, (char*)c->src[k],
+						      NULL));
+    check_pairs("ctx with target", c, k, ctx_query, ctx);
+  }
+  g_query_ctx_free(ctx);
+}
+
+static void test_csr_loader(CASE *c) {
+  FILE *fp = fopen(GRAPH_FILE, "r");
+  GRAPH *h = fp != NULL ? g_from_stream_csr(fp) : NULL;
+
+  if(fp != NULL)
+    fclose(fp);
+  check_same_graph("g_from_stream_csr", c, h);
+  if(h != NULL)
+    g_free(h);
+}
+
+/* thread counts that do not divide the sizes of the generated graphs */
+static void test_parallel_loader(CASE *c) {
+  static const int nthreads[] = {1, 3, 7};
+  char what[64];
+  GRAPH *h;
+  int i;
+
+  for(i = 0; i < (int)(sizeof(nthreads) / sizeof(nthreads[0])); i++) {
+    h = g_from_file_parallel(GRAPH_FILE, nthreads[i]);
+    sprintf(what, "g_from_file_parallel, %i threads", nthreads[i]);
+    check_same_graph(what, c, h);
+    if(h != NULL)
+      g_free(h);
+  }
+}
+
+/* one test: r holds exactly ref's distances and next hops */
+static void check_same_rpt(const char *what, CASE *c, PATH_RPT *ref,
+			   PATH_RPT *r) {
+  int v, bad = r == NULL;
+
+  for(v = 0; !bad && v < c->n; v++)
+    bad = rpt_dist(r, v) != rpt_dist(ref, v) ||
+      rpt_next_hop(r, v) != rpt_next_hop(ref, v);
+  check_status(what, !bad, 1);
+}
+
+/*
+ * saved reports load with the same distances and preds (float
+ *   distances are exact for the small integer weights), and only for
+ *   the graph they were computed on
+ */
+static void test_rptfile(CASE *c) {
+  GRAPH *h;
+  PATH_RPT *r;
+  int use_float, v;
+
+  for(use_float = 0; use_float <= 1; use_float++) {
+    check_status("rpt_save", rpt_save(c->ref[0], RPT_FILE, use_float), 1);
+    r = rpt_load(c->g, RPT_FILE);
+    check_same_rpt(use_float ? "rpt_load, float" : "rpt_load", c, c->ref[0],
+		   r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+
+  // the same names and edges, one weight changed
+  h = load();
+  for(v = 0; v < c->n && g_set_edge_weight(h, (char*)c->src[0],
+	(char*)g_vertex_name(h, v), 100) <= 0; v++)
+    ;
+  r = rpt_load(h, RPT_FILE);
+  check_status("rpt_load for another version of the graph",
+	       v < c->n && r == NULL, 1);
+  if(r != NULL)
+    rpt_free(r);
+  g_free(h);
+
+  truncate(RPT_FILE, 64);
+  r = rpt_load(c->g, RPT_FILE);
+  check_status("rpt_load of a truncated file", r != NULL, 0);
+  if(r != NULL)
+    rpt_free(r);
+  remove(RPT_FILE);
+}
+
+/* one of the threads of test_first_queries: source k on graph h */
+typedef struct {
+  CASE *c;
+  GRAPH *h;
+  int k;
+  int bad;
+} FIRST_JOB;
+
+static void * first_query(void *arg) {
+  FIRST_JOB *job = arg;
+  QUERY_CTX *ctx = g_query_ctx_create(job->h);
+  PATH_RPT *r = g_shortest_path_ctx(ctx, (char*)job->c->src[job->k], NULL);
+  int v;
+
+  job->bad = r == NULL;
+  for(v = 0; r != NULL && v < job->c->n; v++)
+    job->bad += !same_dist(rpt_dist(r, v), rpt_dist(job->c->ref[job->k], v));
+  g_query_ctx_free(ctx);
+  return NULL;
+}
+
+/*
+ * the first searches on a fresh graph, all at once: on directed
+ *   graphs they race to build the reverse edges
+ */
+static void test_first_queries(CASE *c) {
+  GRAPH *h = load();
+  pthread_t tid[NSOURCES];
+  FIRST_JOB job[NSOURCES];
+  int k, bad = 0;
+
+  for(k = 0; k < NSOURCES; k++) {
+    job[k].c = c;
+    job[k].h = h;
+    job[k].k = k;
+    pthread_create(&tid[k], NULL, first_query, &job[k]);
+  }
+  for(k = 0; k < NSOURCES; k++) {
+    pthread_join(tid[k], NULL);
+    bad += job[k].bad;
+  }
+  check_status("concurrent first searches", bad == 0, 1);
+  g_free(h);
+}
+
+/*
+ * compressed adjacency: float weights hold the small integer weights
+ *   exactly; 16-bit fixed point may round each weight by half a step
+ *   of 9 / 65535, so a distance may be off by that much per edge
+ */
+static void test_compress(CASE *c) {
+  static const char *what[] = {"float weights", "fixed16 weights"};
+  int *buf = malloc(sizeof(int) * c->n), wfmt, k, v, s, bad;
+  double tol, diff;
+  GRAPH *h;
+  PATH_RPT *r;
+
+  for(wfmt = G_WEIGHT_FLOAT; wfmt <= G_WEIGHT_FIXED16; wfmt++) {
+    h = load();
+    check_status(what[wfmt], g_compress(h, wfmt), 1);
+    tol = wfmt == G_WEIGHT_FLOAT ? 0 : (c->n - 1) * 0.5 * 9 / 65535;
+    for(k = 0; k < NSOURCES; k++) {
+      r = g_shortest_path(h, (char*)c->src[k]);
+      s = g_vertex_id(h, c->src[k]);
+      for(v = 0, bad = r == NULL; !bad && v < c->n; v++) {
+	diff = fabs(rpt_dist(r, v) - rpt_dist(c->ref[k], v));
+	bad = (rpt_dist(c->ref[k], v) == DBL_MAX) != (rpt_dist(r, v) == DBL_MAX)
+	  || (rpt_dist(r, v) != DBL_MAX && diff > tol + 1e-9)
+	  || !path_ok(h, r, v, s, buf);
+	if(bad)
+	  printf("%s from %s: %s at %g, expected %g\n", what[wfmt],
+		 c->src[k], g_vertex_name(h, v), r == NULL ? -1.0 :
+		 rpt_dist(r, v), rpt_dist(c->ref[k], v));
+      }
+      check_status(what[wfmt], !bad, 1);
+      if(r != NULL)
+	rpt_free(r);
+    }
+    g_free(h);
+  }
+  free(buf);
+}
+
+/* duplicates gone, distances kept: collapse keeps the lightest edge */
+static void test_collapse(CASE *c) {
+  GRAPH *h = load();
+  PATH_RPT *r;
+  int k;
+
+  check_status("g_collapse_multi_edges", g_collapse_multi_edges(h) >= 0, 1);
+  for(k = 0; k < NSOURCES; k++) {
+    r = g_shortest_path(h, (char*)c->src[k]);
+    check_tree("collapsed", c, k, h, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  check_status("collapse twice", g_collapse_multi_edges(h) == 0, 1);
+  g_free(h);
+}
+
+static void test_chains(CASE *c) {
+  GRAPH *h = load();
+  PATH_RPT *r;
+  int k;
+
+  check_status("g_contract_chains", g_contract_chains(h) >= 0, !c->directed);
+  for(k = 0; k < NSOURCES && !c->directed; k++) {
+    r = g_shortest_path(h, (char*)c->src[k]);
+    check_tree("chains", c, k, h, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  g_free(h);
+}
+
+static void test_fringe(CASE *c) {
+  GRAPH *h = load();
+  PATH_RPT *r;
+  int k;
+
+  check_status("g_peel_fringe", g_peel_fringe(h) >= 0, !c->directed);
+  for(k = 0; k < NSOURCES && !c->directed; k++) {
+    r = g_shortest_path(h, (char*)c->src[k]);
+    check_tree("fringe", c, k, h, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  g_free(h);
+}
+
+static void test_tiled(CASE *c) {
+  GRAPH *h;
+  PATH_RPT *r;
+  int k;
+
+  check_status("g_write_tiles", g_write_tiles(c->g, TILE_FILE, 64), 1);
+  h = g_open_tiled(TILE_FILE, 3);
+  check_status("g_open_tiled", h != NULL, 1);
+  if(h == NULL)
+    return;
+  for(k = 0; k < NSOURCES; k++) {
+    r = g_shortest_path(h, (char*)c->src[k]);
+    check_tree("tiled", c, k, h, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  // tiles that cannot be read any more fail the search, not the process
+  truncate(TILE_FILE, 4096);
+  r = g_shortest_path_delta(h, (char*)c->src[0], 0, 1);
+  check_status("search on a truncated tile file", r != NULL, 0);
+  if(r != NULL)
+    rpt_free(r);
+  g_free(h);
+  remove(TILE_FILE);
+}
+
+/*
+ * each order in turn on one graph: names, ids and the name view stay
+ *   as they were, and searches still give the reference trees
+ */
+static void test_reorder(CASE *c) {
+  static const char *what[] = {"BFS order", "RCM order", "Hilbert order"};
+  GRAPH *h = load();
+  const char **view = g_get_names_v(h);
+  double *x = malloc(sizeof(double) * c->n);
+  double *y = malloc(sizeof(double) * c->n);
+  PATH_RPT *r;
+  int method, v, k, bad;
+
+  for(v = 0; v < c->n; v++) {
+    x[v] = rand() % 1000;
+    y[v] = rand() % 1000;
+  }
+  g_set_coords(h, x, y);
+  for(method = G_ORDER_BFS; method <= G_ORDER_HILBERT; method++) {
+    check_status(what[method], g_reorder(h, method), 1);
+    bad = g_get_names_v(h) != view;
+    for(v = 0; v < c->n && !bad; v++)
+      bad = strcmp(view[v], g_vertex_name(c->g, v)) != 0 ||
+	strcmp(g_vertex_name(h, v), g_vertex_name(c->g, v)) != 0 ||
+	g_vertex_id(h, g_vertex_name(c->g, v)) != v;
+    check_status(what[method], !bad, 1);
+    for(k = 0; k < NSOURCES; k++) {
+      r = g_shortest_path(h, (char*)c->src[k]);
+      check_tree(what[method], c, k, h, r);
+      if(r != NULL)
+	rpt_free(r);
+    }
+  }
+  free(x);
+  free(y);
+  g_free(h);
+}
+
+/*
+ * sets entry k of an int32 array of the tile file (0: degrees, 1:
+ *   int2ext) to val, following the layout in tiles.c
+ */
+static int patch_tiles(int n, int which, int k, int val) {
+  FILE *fp = fopen(TILE_FILE, "r+b");
+  unsigned long long names_len;
+  long off;
+  int32_t x = val;
+  int ok;
+
+  if(fp == NULL)
+    return 0;
+  ok = fseek(fp, 32, SEEK_SET) == 0 &&
+    fread(&names_len, sizeof(names_len), 1, fp) == 1;
+  off = 40 + ((names_len + 7) & ~7ULL) + which * ((4L * n + 7) & ~7L) + 4L * k;
+  ok = ok && fseek(fp, off, SEEK_SET) == 0 && fwrite(&x, 4, 1, fp) == 1;
+  fclose(fp);
+  return ok;
+}
+
+/*
+ * tiles of a renumbered graph, then copies with a degree that does
+ *   not add up to its tile's edges or an int2ext that is no
+ *   permutation, which must not open
+ */
+static void test_tile_checks(CASE *c) {
+  GRAPH *h = load(), *t;
+  PATH_RPT *r;
+  int k;
+
+  g_reorder(h, G_ORDER_RCM);
+  check_status("g_write_tiles, renumbered", g_write_tiles(h, TILE_FILE, 64), 1);
+  t = g_open_tiled(TILE_FILE, 2);
+  check_status("g_open_tiled, renumbered", t != NULL, 1);
+  for(k = 0; t != NULL && k < NSOURCES; k++) {
+    r = g_shortest_path(t, (char*)c->src[k]);
+    check_tree("tiled, renumbered", c, k, t, r);
+    if(r != NULL)
+      rpt_free(r);
+  }
+  if(t != NULL)
+    g_free(t);
+
+  patch_tiles(c->n, 0, 1, g_size(h));
+  t = g_open_tiled(TILE_FILE, 2);
+  check_status("tiles with a wrong degree", t != NULL, 0);
+  if(t != NULL)
+    g_free(t);
+
+  g_write_tiles(h, TILE_FILE, 64);
+  patch_tiles(c->n, 1, 1, 0);
+  patch_tiles(c->n, 1, 2, 0);
+  t = g_open_tiled(TILE_FILE, 2);
+  check_status("tiles with a repeated external id", t != NULL, 0);
+  if(t != NULL)
+    g_free(t);
+  g_free(h);
+  remove(TILE_FILE);
+}
+
+static PATH_RPT * overlay_query(void *ov, char *src, char *target) {
+  return g_shortest_path_overlay(ov, src, target);
+}
+
+static void test_overlay(CASE *c) {
+  OVERLAY *ov = g_overlay_create(c->g, 32, 2);
+  int k;
+
+  check_status("g_overlay_create", ov != NULL, 1);
+  if(ov == NULL)
+    return;
+  for(k = 0; k < NSOURCES; k++)
+    check_pairs("overlay", c, k, overlay_query, ov);
+  // recustomizing on more threads gives the same cliques
+  check_status("g_overlay_customize", g_overlay_customize(ov, 3), 1);
+  for(k = 0; k < NSOURCES; k++)
+    check_pairs("overlay, 3 threads", c, k, overlay_query, ov);
+  g_overlay_free(ov);
+}
+
+static PATH_RPT * arcflags_query(void *af, char *src, char *target) {
+  return g_shortest_path_arcflags(af, src, target);
+}
+
+static void test_arcflags(CASE *c) {
+  ARCFLAGS *af = g_arcflags_create(c->g, 8, 3);
+  int k;
+
+  check_status("g_arcflags_create", af != NULL, 1);
+  if(af == NULL)
+    return;
+  for(k = 0; k < NSOURCES; k++)
+    check_pairs("arc flags", c, k, arcflags_query, af);
+  check_status("g_arcflags_save", g_arcflags_save(af, FLAG_FILE), 1);
+  g_arcflags_free(af);
+  af = g_arcflags_load(c->g, FLAG_FILE);
+  check_status("g_arcflags_load", af != NULL, 1);
+  for(k = 0; af != NULL && k < NSOURCES; k++)
+    check_pairs("loaded arc flags", c, k, arcflags_query, af);
+  if(af != NULL)
+    g_arcflags_free(af);
+  remove(FLAG_FILE);
+}
+
+/* one lookup thread: random names, present ("v0".."v<n-1>") or not */
+typedef struct {
+  CASE *c;
+  int *ids;        // g_vertex_id of each present name, looked up first
+  unsigned seed;
+  int bad;
+} LOOKUP_JOB;
+
+static void * lookup_thread(void *arg) {
+  LOOKUP_JOB *job = arg;
+  char name[32];
+  int i, v, present;
+
+  for(i = 0; i < NLOOKUPS; i++) {
+    v = rand_r(&job->seed) % (2 * job->c->n);
+    sprintf(name, rand_r(&job->seed) % 8 ? "v%i" : "v%ix", v);
+    present = v < job->c->n && name[strlen(name) - 1] != 'x';
+    if(g_contains(job->c->g, name) != present ||
+       g_vertex_id(job->c->g, name) != (present ? job->ids[v] : -1))
+      job->bad++;
+  }
+  return NULL;
+}
+
+/* name lookups from several threads at once on the loaded graph */
+static void test_lookups(CASE *c) {
+  pthread_t tid[NLOOKUP_THREADS];
+  LOOKUP_JOB job[NLOOKUP_THREADS];
+  int *ids = malloc(c->n * sizeof(int));
+  char name[32];
+  int i, bad = 0;
+
+  for(i = 0; i < c->n; i++) {
+    sprintf(name, "v%i", i);
+    ids[i] = g_vertex_id(c->g, name);
+    if(ids[i] < 0 || strcmp(g_vertex_name(c->g, ids[i]), name) != 0)
+      bad++;
+  }
+  for(i = 0; i < NLOOKUP_THREADS; i++) {
+    job[i].c = c;
+    job[i].ids = ids;
+    job[i].seed = rand();
+    job[i].bad = 0;
+    pthread_create(&tid[i], NULL, lookup_thread, &job[i]);
+  }
+  for(i = 0; i < NLOOKUP_THREADS; i++) {
+    pthread_join(tid[i], NULL);
+    bad += job[i].bad;
+  }
+  check_status("concurrent name lookups", bad == 0, 1);
+  free(ids);
+}
+
+/* the engine tests, each run on every generated graph */
+static void (*engine_tests[])(CASE *) = {
+  test_reference,
+  test_lookups,
+  test_csr_loader,
+  test_parallel_loader,
+  test_rptfile,
+  test_delta,
+  test_ctx,
+  test_first_queries,
+  test_compress,
+  test_collapse,
+  test_chains,
+  test_fringe,
+  test_reorder,
+  test_tiled,
+  test_tile_checks,
+  test_overlay,
+  test_arcflags,
+};
+
+static const char *load_mode[] = {"list", "CSR", "packed"};
+
+/* g from text, with list (m = 0), CSR (1) or packed (2) adjacency */
+static GRAPH * load_text(const char *text, int m) {
+  FILE *fp;
+  GRAPH *h;
+
+  if((fp = fopen(GRAPH_FILE, "w")) == NULL)
+    return NULL;
+  fputs(text, fp);
+  fclose(fp);
+  fp = fopen(GRAPH_FILE, "r");
+  h = m == 1 ? g_from_stream_csr(fp) : g_from_stream(fp);
+  fclose(fp);
+  if(m == 2)
+    g_compress(h, G_WEIGHT_FLOAT);
+  return h;
+}
+
+static int cmp_str(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+/*
+ * one test: the out-edges of src, in name order, are exactly want
+ *   ("x:w y:w ...")
+ */
+static void check_edges(const char *what, GRAPH *h, const char *src,
+			const char *want) {
+  const char *names[8];
+  double w[8];
+  char edge[8][32], got[256];
+  int k, deg = g_get_neighbors_v(h, src, names, w, 8), len = 0;
+
+  for(k = 0; k < deg && k < 8; k++)
+    sprintf(edge[k], "%s:%g", names[k], w[k]);
+  qsort(edge, k, sizeof(edge[0]), cmp_str);
+  got[0] = '\0';
+  for(k = 0; k < deg && k < 8; k++)
+    len += sprintf(got + len, "%s%s", k > 0 ? " " : "", edge[k]);
+  if(strcmp(got, want) != 0)
+    printf("%s: %s has %s, expected %s\n", what, src, got, want);
+  testfail += strcmp(got, want) != 0;
+  testtotal++;
+}
+
+/*
+ * g_collapse_multi_edges on small graphs whose duplicates are known,
+ *   in each adjacency mode.  Undirected, a b 5 / b a 3 are the same
+ *   road; directed, they are not.
+ */
+static void test_collapse_counts(void) {
+  static const char *text[] = {
+    "4\na b 5\nb a 3\na b 7\nb c 2\nc b 4\nc d 1\n",
+    "4 directed\na b 5\nb a 3\na b 7\nb c 2\nc b 4\nc d 1\nc d 6\n"};
+  char what[64];
+  GRAPH *h;
+  int directed, m;
+
+  printf("collapsing multi-edges\n");
+  for(directed = 0; directed <= 1; directed++) {
+    for(m = 0; m < 3; m++) {
+      if((h = load_text(text[directed], m)) == NULL)
+	return;
+      sprintf(what, "%s collapse, %s", directed ? "directed" : "undirected",
+	      load_mode[m]);
+      check_status(what, g_collapse_multi_edges(h) == (directed ? 2 : 3), 1);
+      check_edges(what, h, "a", directed ? "b:5" : "b:3");
+      check_edges(what, h, "c", directed ? "b:4 d:1" : "b:2 d:1");
+      if(!directed)
+	check_edges(what, h, "b", "a:3 c:2");
+      g_free(h);
+    }
+  }
+  remove(GRAPH_FILE);
+}
+
+/*
+ * one test: the path from v in r is want ("v ... source"), dist long
+ */
+static void check_path(const char *what, PATH_RPT *r, const char *v,
+		       const char *want, double dist) {
+  const char *buf[16];
+  char got[256];
+  double d = -1;
+  int k, len = 0, size = rpt_path_v(r, v, &d, buf, 16);
+
+  got[0] = '\0';
+  for(k = 0; k < size && k < 16; k++)
+    len += sprintf(got + len, "%s%s", k > 0 ? " " : "", buf[k]);
+  if(strcmp(got, want) != 0 || !same_dist(d, dist))
+    printf("%s: path from %s is %s (%g), expected %s (%g)\n", what, v, got,
+	   d, want, dist);
+  testfail += strcmp(got, want) != 0 || !same_dist(d, dist);
+  testtotal++;
+}
+
+/*
+ * g_contract_chains on a small graph whose chains are known, in each
+ *   adjacency mode.  x, y (a - x - y - b) and c (a - c - b) are
+ *   interior; the ring r1 r2 r3 has no core vertex and stays, p has
+ *   two edges to one neighbor and stays.
+ */
+static void test_chain_counts(void) {
+  static const char *text =
+    "10\na x 1\nx y 2\ny b 3\na b 10\na c 2\nc b 4\nb d 1\n"
+    "r1 r2 1\nr2 r3 1\nr3 r1 1\nd p 1\nd p 2\n";
+  char what[64];
+  PATH_RPT *r;
+  GRAPH *h;
+  int m;
+
+  printf("contracting chains\n");
+  for(m = 0; m < 3; m++) {
+    if((h = load_text(text, m)) == NULL)
+      return;
+    sprintf(what, "chains, %s", load_mode[m]);
+    check_status(what, g_contract_chains(h) == 3, 1);
+    r = g_shortest_path(h, "x");
+    check_path(what, r, "b", "b y x", 5);
+    check_path(what, r, "c", "c a x", 3);
+    check_path(what, r, "p", "p d b y x", 7);
+    rpt_free(r);
+    r = g_shortest_path(h, "c");
+    check_path(what, r, "y", "y x a c", 5);
+    check_path(what, r, "d", "d b c", 5);
+    check_status(what, rpt_dist(r, g_vertex_id(h, "r1")) == DBL_MAX, 1);
+    rpt_free(r);
+    r = g_shortest_path(h, "r1");
+    check_path(what, r, "r3", "r3 r1", 1);
+    rpt_free(r);
+    g_free(h);
+  }
+  h = load_text("3 directed\na b 1\nb c 1\n", 0);
+  check_status("chains, directed", g_contract_chains(h) == -1, 1);
+  g_free(h);
+  remove(GRAPH_FILE);
+}
+
+static void test_graph(int n, int extra, int directed) {
+  CASE c;
+  int k, i;
+
+  printf("%s graph, %i vertices\n", directed ? "directed" : "undirected", n);
+  if(!write_graph(n, extra, directed) || (c.g = load()) == NULL) {
+    check_status("writing the graph", 0, 1);
+    return;
+  }
+  c.directed = directed;
+  c.n = n;
+  for(k = 0; k < NSOURCES; k++) {
+    c.src[k] = g_vertex_name(c.g, rand() % n);
+    c.ref[k] = g_shortest_path(c.g, (char*)c.src[k]);
+  }
+  for(i = 0; i < (int)(sizeof(engine_tests) / sizeof(engine_tests[0])); i++)
+    engine_tests[i](&c);
+  for(k = 0; k < NSOURCES; k++)
+    rpt_free(c.ref[k]);
+  g_free(c.g);
+  remove(GRAPH_FILE);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned seed = argc > 1 ? (unsigned)atoi(argv[1]) : (unsigned)time(NULL);
+
+  printf("seed %u\n", seed);
+  srand(seed);
+  test_collapse_counts();
+  test_chain_counts();
+  test_graph(500, 150, 0);
+  test_graph(2000, 1000, 0);
+  test_graph(500, 400, 1);
+  test_graph(2000, 2000, 1);
+  printf("\n%i/%i PASSED\n", testtotal - testfail, testtotal);
+  return testfail > 0;
+}
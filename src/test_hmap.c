@@ -0,0 +1,377 @@
+/**
+ * Tests of hmap.
+ *
+ * usage:  test_hmap [seed]
+ *
+ * Runs random inserts, overwrites, lookups and removals against a
+ *   plain array that knows which keys are present, with the built-in
+ *   hash functions and with a deliberately bad one that sends many
+ *   keys to the same home slot (so that Robin Hood displacement and
+ *   the backward shift of removals run all the time).
+ *   Keys of 16 characters or more are kept out of the slot, so
+ *   keys on either side of that length, and keys that differ only
+ *   past it, get tests of their own.
+ *   hmap_find_or_insert and hmap_lookup keep per-key counters through
+ *   resizes.  The same runs in incremental resize mode, and lookups and
+ *   removals while a migration is only part way through.
+ *   Also checks hmap_get_stats and hmap_dump_stats on a map whose
+ *   probe lengths are known.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hmap.h"
+
+#define NKEYS 3000
+#define NOPS 40000
+
+static int testtotal = 0, testfail = 0;
+
+/**** UTILITY FUNCTIONS *******/
+
+/* a few distinct hash values for all keys: long collision runs */
+static unsigned clump_hash(char *key) {
+  unsigned h = 0;
+  while(*key)
+    h += (unsigned char)*key++;
+  return (h % 7) * 0x10000000u;
+}
+
+/* every key homed in slot 0: probe lengths 1, 2, 3, ... */
+static unsigned zero_hash(char *key) {
+  return 0;
+}
+
+static void check(const char *what, int ok) {
+  if(!ok)
+    printf("FAILED: %s\n", what);
+  testfail += !ok;
+  testtotal++;
+}
+
+/* key i: "k<i>_", padded with letters to len characters if shorter */
+static void make_key(char *buf, int i, int len) {
+  int k = sprintf(buf, "k%i_", i);
+  while(k < len) {
+    buf[k] = 'a' + (i + k) % 26;
+    k++;
+  }
+  buf[k] = '\0';
+}
+
+/*
+ * one test: NOPS random operations on keys of the given lengths, each
+ *   checked against vals[] (NULL: absent)
+ */
+static void random_ops(const char *what, HMAP_PTR map, int minlen,
+		       int maxlen) {
+  char (*keys)[64] = malloc(sizeof(*keys) * NKEYS);
+  void **vals = calloc(NKEYS, sizeof(void*)), *ret, *want;
+  int i, op, n = 0, ok = 1;
+
+  for(i = 0; i < NKEYS; i++)
+    make_key(keys[i], i, minlen + rand() % (maxlen - minlen + 1));
+  for(op = 0; op < NOPS && ok; op++) {
+    i = rand() % NKEYS;
+    switch(rand() % 4) {
+    case 0:
+    case 1:
+      want = (void*)(long)(op + 1);
+      ret = hmap_set(map, keys[i], want);
+      ok = ret == vals[i];  // the previous value, NULL for a new key
+      n += vals[i] == NULL;
+      vals[i] = want;
+      break;
+    case 2:
+      ret = hmap_remove(map, keys[i]);
+      ok = ret == vals[i];
+      n -= vals[i] != NULL;
+      vals[i] = NULL;
+      break;
+    default:
+      ok = hmap_get(map, keys[i]) == vals[i] &&
+	hmap_contains(map, keys[i]) == (vals[i] != NULL);
+    }
+    ok = ok && hmap_size(map) == n;
+  }
+  if(!ok)
+    printf("%s: operation %i on %s went wrong\n", what, op - 1, keys[i]);
+  // every key, present or not, one last time
+  for(i = 0; i < NKEYS && ok; i++)
+    ok = hmap_get(map, keys[i]) == vals[i] &&
+      hmap_contains(map, keys[i]) == (vals[i] != NULL);
+  check(what, ok);
+  free(keys);
+  free(vals);
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+static void test_basic(void) {
+  HMAP_PTR map = hmap_create(0, 0);
+  int x = 1, y = 2;
+  void *vp = &x;
+
+  check("new key: hmap_set returns NULL", hmap_set(map, "a", &x) == NULL);
+  check("old key: hmap_set returns the old value",
+	hmap_set(map, "a", &y) == &x);
+  check("hmap_get after overwrite", hmap_get(map, "a") == &y);
+  check("NULL value is contained", hmap_set(map, "b", NULL) == NULL &&
+	hmap_contains(map, "b") && hmap_size(map) == 2);
+  check("hmap_remove returns the value", hmap_remove(map, "a") == &y);
+  check("hmap_remove of an absent key", hmap_remove(map, "a") == NULL &&
+	hmap_size(map) == 1 && !hmap_contains(map, "a"));
+  check("hmap_lookup of a NULL value", hmap_lookup(map, "b", &vp) == 1 &&
+	vp == NULL);
+  check("hmap_lookup of an absent key", hmap_lookup(map, "a", &vp) == 0 &&
+	vp == NULL);
+  check("hash function fixed once not empty",
+	hmap_set_hfunc(map, NAIVE_HFUNC) == 0);
+  hmap_free(map, 0);
+}
+
+/*
+ * counts random draws of keys with hmap_find_or_insert (the value
+ *   field holds the count) through resizes, incremental or not
+ */
+static void test_find_or_insert(int incremental) {
+  HMAP_PTR map = hmap_create(0, 0);
+  int *count = calloc(NKEYS, sizeof(int));
+  char key[64];
+  void **vp, *val;
+  int i, op, created, ok = 1;
+
+  hmap_set_incremental(map, incremental);
+  for(op = 0; op < NOPS && ok; op++) {
+    i = rand() % NKEYS;
+    make_key(key, i, 0);
+    vp = hmap_find_or_insert(map, key, &created);
+    ok = created == (count[i] == 0) && *vp == (void*)(long)count[i];
+    *vp = (void*)(long)++count[i];
+  }
+  for(i = 0; i < NKEYS && ok; i++) {
+    make_key(key, i, 0);
+    val = (void*)-1;
+    if(count[i] == 0)
+      ok = hmap_lookup(map, key, &val) == 0 && val == (void*)-1;
+    else
+      ok = hmap_lookup(map, key, &val) == 1 && val == (void*)(long)count[i];
+  }
+  check(incremental ? "find_or_insert counts, incremental resize" :
+	"find_or_insert counts", ok);
+  hmap_free(map, 0);
+  free(count);
+}
+
+static void test_collisions(void) {
+  HMAP_PTR map;
+  int id;
+  char name[64];
+
+  for(id = 0; id <= XXHASH_HFUNC; id++) {
+    map = hmap_create(0, 0);
+    hmap_set_hfunc(map, id);
+    sprintf(name, "random operations, %s", hmap_hfunc_desc(map));
+    random_ops(name, map, 2, 12);
+    hmap_free(map, 0);
+  }
+  map = hmap_create(0, 0.9);
+  check("user hash function on an empty map",
+	hmap_set_user_hfunc(map, clump_hash, "clumped"));
+  random_ops("random operations, colliding hash", map, 2, 12);
+  hmap_free(map, 0);
+}
+
+/*
+ * keys around the inline limit and keys that differ only after
+ *   their first 16 characters, all with the same hash value
+ */
+static void test_long_keys(void) {
+  static char *edge[] = {"abcdefghijklmn", "abcdefghijklmno",
+			 "abcdefghijklmnop", "abcdefghijklmnopq",
+			 "abcdefghijklmnoq", "abcdefghijklmnopr"};
+  int ne = sizeof(edge) / sizeof(edge[0]);
+  HMAP_PTR map = hmap_create(0, 0);
+  HMAP_STATS st;
+  unsigned long base, ext = 0;
+  char key[64];
+  int i, ok = 1;
+
+  hmap_set_user_hfunc(map, zero_hash, "zero");
+  hmap_get_stats(map, &st);
+  base = st.bytes_allocated;
+  for(i = 0; i < ne; i++) {
+    hmap_set(map, edge[i], edge[i]);
+    if(strlen(edge[i]) >= 16)
+      ext += strlen(edge[i]) + 1;
+  }
+  for(i = 0; i < 50; i++) {
+    sprintf(key, "abcdefghijklmnop_%i", i);
+    hmap_set(map, key, (void*)(long)(i + 1));
+    ext += strlen(key) + 1;
+  }
+  for(i = 0; i < ne && ok; i++)
+    ok = hmap_get(map, edge[i]) == edge[i];
+  for(i = 0; i < 50 && ok; i++) {
+    sprintf(key, "abcdefghijklmnop_%i", i);
+    ok = hmap_get(map, key) == (void*)(long)(i + 1);
+  }
+  ok = ok && !hmap_contains(map, "abcdefghijklmnop_") &&
+    !hmap_contains(map, "abcdefghijklmnopqr") &&
+    !hmap_contains(map, "abcdefghijklm");
+  hmap_get_stats(map, &st);
+  check("keys at and past the inline length", ok &&
+	st.bytes_allocated == base + ext);
+
+  // remove every other key; the rest must still be found
+  for(i = 0; i < ne; i += 2)
+    ok = ok && hmap_remove(map, edge[i]) == edge[i];
+  for(i = 0; i < 50; i += 2) {
+    sprintf(key, "abcdefghijklmnop_%i", i);
+    ok = ok && hmap_remove(map, key) == (void*)(long)(i + 1);
+  }
+  for(i = 0; i < ne && ok; i++)
+    ok = hmap_get(map, edge[i]) == (i % 2 ? edge[i] : NULL) &&
+      hmap_contains(map, edge[i]) == i % 2;
+  for(i = 0; i < 50 && ok; i++) {
+    sprintf(key, "abcdefghijklmnop_%i", i);
+    ok = hmap_contains(map, key) == i % 2;
+  }
+  check("removal of long keys", ok && hmap_size(map) == ne / 2 + 25);
+  hmap_free(map, 0);
+
+  map = hmap_create(0, 0);
+  random_ops("random operations, long keys", map, 14, 40);
+  hmap_free(map, 0);
+  map = hmap_create(0, 0.9);
+  hmap_set_user_hfunc(map, clump_hash, "clumped");
+  random_ops("random operations, long keys, colliding hash", map, 14, 40);
+  hmap_free(map, 0);
+}
+
+static void test_stats(void) {
+  HMAP_PTR map = hmap_create(64, 0.9);
+  HMAP_STATS st;
+  FILE *fp;
+  char key[64], line[512], want[512];
+  int i, sum, ok;
+
+  hmap_set_user_hfunc(map, zero_hash, "zero");
+  for(i = 0; i < 20; i++) {
+    make_key(key, i, 0);
+    hmap_set(map, key, NULL);
+  }
+  hmap_get_stats(map, &st);
+  for(i = 0, ok = 1; i < HMAP_HIST_LEN - 1; i++)
+    ok = ok && st.probe_hist[i] == 1;
+  check("stats of one collision run",
+	ok && st.probe_hist[HMAP_HIST_LEN - 1] == 5 && st.n == 20 &&
+	st.tsize == 64 && st.max_probe == 20 && st.mean_probe == 10.5 &&
+	st.resize_count == 0 && st.bytes_allocated > 64 * 16 &&
+	strcmp(st.hfunc_desc, "zero") == 0);
+
+  fp = tmpfile();
+  hmap_dump_stats(map, fp);
+  rewind(fp);
+  sprintf(want, "{\"n\": 20, \"tsize\": 64, \"load_factor\": 0.312500, "
+	  "\"mean_probe\": 10.500000, \"max_probe\": 20, \"resize_count\": 0, "
+	  "\"bytes_allocated\": %lu, \"probe_hist\": [1, 1, 1, 1, 1, 1, 1, 1, "
+	  "1, 1, 1, 1, 1, 1, 1, 5]}\n", st.bytes_allocated);
+  check("JSON stats line", fgets(line, sizeof(line), fp) != NULL &&
+	strcmp(line, want) == 0 && fgetc(fp) == EOF);
+  fclose(fp);
+  hmap_free(map, 0);
+
+  // a default map that has grown: histogram covers every key
+  map = hmap_create(0, 0);
+  for(i = 0; i < NKEYS; i++) {
+    make_key(key, i, 0);
+    hmap_set(map, key, NULL);
+  }
+  hmap_get_stats(map, &st);
+  for(i = 0, sum = 0; i < HMAP_HIST_LEN; i++)
+    sum += st.probe_hist[i];
+  check("stats after resizing", sum == NKEYS && st.n == NKEYS &&
+	st.resize_count > 0 && st.load_factor <= DEFAULT_LFACTOR &&
+	st.tsize == DEFAULT_INIT_SIZE << st.resize_count &&
+	st.mean_probe >= 1 && st.max_probe >= st.mean_probe);
+  hmap_free(map, 0);
+}
+
+/*
+ * grows an incremental map by one resize, then looks keys up,
+ *   removes and adds some before the old table is drained
+ */
+static void half_drained(const char *what, HFUNC hfunc) {
+  HMAP_PTR map = hmap_create(0, 0);
+  HMAP_STATS st;
+  char key[64];
+  int i, j, n, ok = 1;
+
+  if(hfunc != NULL)
+    hmap_set_user_hfunc(map, hfunc, "user");
+  hmap_set_incremental(map, 1);
+  for(n = 0; ; n++) {
+    hmap_get_stats(map, &st);
+    if(st.resize_count > 0)
+      break;
+    make_key(key, n, 0);
+    hmap_set(map, key, (void*)(long)(n + 1));
+  }
+  // keys 0..n-1 present; a write drains only a few old slots, so
+  //   the removals (of every third key) and additions all run
+  //   against a half-drained table
+  for(i = 0; i < n && ok; i += 3) {
+    make_key(key, i, 0);
+    ok = hmap_remove(map, key) == (void*)(long)(i + 1) &&
+      hmap_remove(map, key) == NULL;
+    make_key(key, n + i, 0);
+    ok = ok && hmap_set(map, key, (void*)(long)(n + i + 1)) == NULL;
+    for(j = 0; j < n + i + 1 && ok; j++) {
+      make_key(key, j, 0);
+      if((j < n && j % 3 == 0 && j <= i) || (j >= n && (j - n) % 3 != 0))
+	ok = !hmap_contains(map, key);
+      else
+	ok = hmap_get(map, key) == (void*)(long)(j + 1);
+    }
+  }
+  hmap_get_stats(map, &st);
+  for(i = 0, j = 0; i < HMAP_HIST_LEN; i++)
+    j += st.probe_hist[i];
+  check(what, ok && j == hmap_size(map) && st.resize_count == 1);
+  hmap_free(map, 0);
+}
+
+static void test_migration(void) {
+  HMAP_PTR map;
+
+  half_drained("half-drained migration", NULL);
+  half_drained("half-drained migration, colliding hash", clump_hash);
+  map = hmap_create(0, 0);
+  hmap_set_incremental(map, 1);
+  random_ops("random operations, incremental resize", map, 2, 12);
+  hmap_free(map, 0);
+  map = hmap_create(0, 0.9);
+  hmap_set_user_hfunc(map, clump_hash, "clumped");
+  hmap_set_incremental(map, 1);
+  random_ops("random operations, incremental, colliding hash", map, 2, 12);
+  hmap_free(map, 0);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned seed = argc > 1 ? (unsigned)atoi(argv[1]) : (unsigned)time(NULL);
+
+  printf("seed %u\n", seed);
+  srand(seed);
+  test_basic();
+  test_collisions();
+  test_find_or_insert(0);
+  test_find_or_insert(1);
+  test_long_keys();
+  test_stats();
+  test_migration();
+  printf("\n%i/%i PASSED\n", testtotal - testfail, testtotal);
+  return testfail > 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * Tests of mphf.
+ *
+ * usage:  test_mphf [seed]
+ *
+ * Includes mphf.c itself, built with only a few levels so that a
+ *   good share of the keys ends up in the hmap fallback, and checks
+ *   the internals directly: every key of a generated set gets its
+ *   own index in [0, n), each rank sample counts the set bits before
+ *   it, and keys outside the set get -1 or an index in range (which
+ *   callers such as the graph's name lookup then reject by comparing
+ *   the key).
+ */
+#define MAX_LEVELS 4
+#include "mphf.c"
+#include <time.h>
+
+#define NKEYS 20000
+
+static int testtotal = 0, testfail = 0;
+
+/**** UTILITY FUNCTIONS *******/
+
+static void check(const char *what, int ok) {
+  if(!ok)
+    printf("FAILED: %s\n", what);
+  testfail += !ok;
+  testtotal++;
+}
+
+/* n distinct keys of random lengths */
+static char ** make_keys(int n, int salt) {
+  char **keys = malloc(sizeof(char*) * n), buf[64];
+  int i, len, want;
+
+  for(i = 0; i < n; i++) {
+    len = sprintf(buf, "%c%i_", 'a' + salt, i);
+    for(want = 4 + rand() % 30; len < want; len++)
+      buf[len] = 'a' + rand() % 26;
+    buf[len] = '\0';
+    keys[i] = strdup(buf);
+  }
+  return keys;
+}
+
+static void free_keys(char **keys, int n) {
+  int i;
+
+  for(i = 0; i < n; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+static void test_set(int n, double gamma) {
+  char **keys = make_keys(n, 0), **absent = make_keys(n, 1), what[64];
+  char *hit = calloc(n > 0 ? n : 1, 1);
+  MPHF *f = mphf_build(keys, n, gamma);
+  unsigned long w, r;
+  int i, x, ok = 1;
+
+  sprintf(what, "%i keys, gamma %g", n, gamma);
+  // one index each in [0, n): n keys, so that makes it onto
+  for(i = 0; i < n && ok; i++) {
+    x = mphf_lookup(f, keys[i]);
+    ok = x >= 0 && x < n && !hit[x];
+    if(ok)
+      hit[x] = 1;
+  }
+  check(what, ok && mphf_size(f) == n);
+
+  for(w = 0, r = 0; w < f->nwords && ok; w++) {
+    if(w % RANK_WORDS == 0)
+      ok = f->rank[w / RANK_WORDS] == r;
+    r += __builtin_popcountll(f->bits[w]);
+  }
+  check("rank samples", ok && r == (unsigned long)f->nplaced);
+
+  check("keys left for the fallback", n < 1000 || (f->fallback != NULL &&
+	hmap_size(f->fallback) == n - f->nplaced && f->nplaced < n));
+
+  for(i = 0; i < n && ok; i++) {
+    x = mphf_lookup(f, absent[i]);
+    ok = x >= -1 && x < n;
+  }
+  check("keys outside the set", ok);
+
+  mphf_free(f);
+  free(hit);
+  free_keys(keys, n);
+  free_keys(absent, n);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned seed = argc > 1 ? (unsigned)atoi(argv[1]) : (unsigned)time(NULL);
+
+  printf("seed %u\n", seed);
+  srand(seed);
+  test_set(0, 0);
+  test_set(1, 0);
+  test_set(100, 0);
+  test_set(NKEYS, 0);
+  test_set(NKEYS, 1);
+  test_set(NKEYS, 5);
+  printf("\n%i/%i PASSED\n", testtotal - testfail, testtotal);
+  return testfail > 0;
+}
@@ -0,0 +1,486 @@
+/**
+ * Out-of-core tiled graphs (ADJ_TILED).
+ *
+ * g_write_tiles cuts the vertices into tiles of tile_size consecutive
+ *   indices (so run g_reorder first: BFS/RCM or Hilbert order puts
+ *   neighbors into the same tile) and writes one file.  g_open_tiled
+ *   keeps the names, degrees and tile index in memory and reads a
+ *   tile's edges only when edge_begin first asks for one of its
+ *   vertices.  At most cache_tiles tiles are held; the least recently
+ *   used one makes room for the next.  Directed graphs also store
+ *   their in-edges in reverse tiles, which edge_begin_in reads the
+ *   same way, so searches never need the whole reverse in memory.
+ *
+ * File layout (native byte order, all offsets 8-byte aligned):
+ *
+ *   TILE_HDR
+ *   names                  n '\0'-terminated strings ("" = unnamed),
+ *                          padded to a multiple of 8 bytes
+ *   int32 degree[n]        padded
+ *   int32 int2ext[n]       if has_ext, padded
+ *   int32 in_degree[n]     if directed, padded
+ *   TILE_IX index[ntiles]  the tiles, then (if directed) ntiles more
+ *                          for the reverse tiles
+ *   per tile: int32 adj[m] padded, double w[m], the edges of its
+ *             vertices in order (for a reverse tile: the tails of
+ *             their in-edges)
+ *
+ * Version 1 files had no reverse tiles; undirected ones are laid out
+ *   the same and still open.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hmap.h"
+#include "mphf.h"
+#include "graph.h"
+#include "graph_impl.h"
+
+#define TILE_MAGIC "GTILES"
+#define TILE_VERSION 2
+#define TILE_VERSION_UNDIRECTED 1   // oldest version with our layout
+#define DEFAULT_TILE_SIZE 4096
+#define DEFAULT_CACHE_TILES 16
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t directed;
+  int32_t n;
+  int32_t tile_size;     // vertices per tile (the last may have fewer)
+  int32_t ntiles;
+  int32_t has_ext;       // int2ext follows the degrees
+  uint64_t names_len;    // unpadded
+} TILE_HDR;
+
+typedef struct {
+  uint64_t off;          // of the tile's adj[]
+  uint64_t m;            // edges in the tile (sum of its degrees)
+} TILE_IX;
+
+typedef struct {
+  int tile;              // key of the tile held, -1: free
+  unsigned long used;    // tick of the last access
+  long *voff;            // edges of the tile's k-th vertex:
+  int *adj;              //   adj/w[voff[k] .. voff[k+1]-1]
+  weight_t *w;
+  long cap;              // edges adj/w have room for
+} TILE_SLOT;
+
+/* tile keys: t for the out-edges of tile t, ntiles + t for its in-edges */
+struct tile_store {
+  int fd;
+  int n;
+  int tile_size;
+  int ntiles;
+  int nkeys;             // ntiles, twice that if directed
+  TILE_IX *ix;           // by key
+  int *in_degree;        // directed only
+  TILE_SLOT *slots;
+  int nslots;
+  int *slot_of;          // key -> slot holding it, -1 if none
+  unsigned long tick;
+  double *wbuf;          // weights as read, before weight_from_double
+  long wbuf_cap;
+  long hits;
+  long misses;
+  int failed;            // a tile could not be read, see tile_failed
+};
+
+
+/**** UTILITY FUNCTIONS *******/
+
+static size_t pad8(size_t x) {
+  return (x + 7) & ~(size_t)7;
+}
+
+static int write_pad(FILE *fp, size_t len) {
+  static const char pad[8];
+  return pad8(len) == len || fwrite(pad, pad8(len) - len, 1, fp) == 1;
+}
+
+static int read_at(int fd, void *buf, size_t len, uint64_t off) {
+  char *p = buf;
+  ssize_t r;
+
+  while(len > 0) {
+    if((r = pread(fd, p, len, off)) <= 0)
+      return 0;
+    p += r;
+    off += r;
+    len -= r;
+  }
+  return 1;
+}
+
+static const char * vname(GRAPH *g, int u) {
+  return g->vertices[u].name != NULL ? g->vertices[u].name : "";
+}
+
+/* degree of u as counted by tile key */
+static int key_degree(GRAPH *g, TILE_STORE *ts, int key, int u) {
+  if(u >= g->n)
+    return 0;
+  return key < ts->ntiles ? g->vertices[u].out_degree : ts->in_degree[u];
+}
+
+/* reads the tile of key into slot s */
+static int load_tile(GRAPH *g, TILE_STORE *ts, int key, TILE_SLOT *s) {
+  long m = ts->ix[key].m, k;
+  int lo = key % ts->ntiles * ts->tile_size, u;
+
+  if(m > s->cap) {
+    s->cap = m;
+    s->adj = realloc(s->adj, sizeof(int) * m);
+    s->w = realloc(s->w, sizeof(weight_t) * m);
+  }
+  if(m > ts->wbuf_cap) {
+    ts->wbuf_cap = m;
+    ts->wbuf = realloc(ts->wbuf, sizeof(double) * m);
+  }
+  if(m > 0 &&
+     (!read_at(ts->fd, s->adj, sizeof(int32_t) * m, ts->ix[key].off)
+      || !read_at(ts->fd, ts->wbuf, sizeof(double) * m,
+		  ts->ix[key].off + pad8(sizeof(int32_t) * m))))
+    return 0;
+  for(k = 0; k < m; k++) {
+    if(s->adj[k] < 0 || s->adj[k] >= g->n)
+      return 0;
+    s->w[k] = weight_from_double(ts->wbuf[k]);
+  }
+  s->voff[0] = 0;
+  for(u = lo; u < lo + ts->tile_size; u++)
+    s->voff[u-lo+1] = s->voff[u-lo] + key_degree(g, ts, key, u);
+  return s->voff[ts->tile_size] == m;   // g_open_tiled checked, but cheap
+}
+
+/* writes the heads (tails if in) of the edges of tile t, then weights */
+static int write_tile(GRAPH *g, FILE *fp, int t, int tile_size, long m,
+		      int in) {
+  EDGE_IT it;
+  weight_t w;
+  int32_t x;
+  double wd;
+  int u, v, pass, ok = 1;
+
+  for(pass = 0; pass < 2 && ok; pass++) {
+    for(u = t * tile_size; u < (t + 1) * tile_size && u < g->n && ok; u++) {
+      if(in)
+	edge_begin_in(g, u, &it);
+      else
+	edge_begin(g, u, &it);
+      while(ok && edge_next(&it, &v, &w)) {
+	x = v;
+	wd = weight_to_double(w);
+	ok = pass == 0 ? fwrite(&x, sizeof(x), 1, fp) == 1
+	  : fwrite(&wd, sizeof(wd), 1, fp) == 1;
+      }
+    }
+    ok = ok && (pass > 0 || write_pad(fp, sizeof(int32_t) * m));
+  }
+  return ok;
+}
+
+/**** END UTILITY FUNCTIONS *******/
+
+
+
+void tile_edges(GRAPH *g, int u, int in, const int **adj,
+		const weight_t **w, long *i, long *end) {
+  TILE_STORE *ts = g->tiles;
+  TILE_SLOT *s;
+  int t = u / ts->tile_size, key = t + (in ? ts->ntiles : 0), k, lru;
+
+  if(ts->slot_of[key] >= 0) {
+    s = &ts->slots[ts->slot_of[key]];
+    ts->hits++;
+  }
+  else {
+    for(k = 0, lru = 0; k < ts->nslots; k++) {
+      if(ts->slots[k].tile < 0) {
+	lru = k;
+	break;
+      }
+      if(ts->slots[k].used < ts->slots[lru].used)
+	lru = k;
+    }
+    s = &ts->slots[lru];
+    if(s->tile >= 0)
+      ts->slot_of[s->tile] = -1;
+    s->tile = -1;
+    if(!load_tile(g, ts, key, s)) {
+      // the file changed or went away under us: no edges, and the
+      //   public entry point that asked fails
+      fprintf(stderr, "error: cannot read tile %d\n", t);
+      ts->failed = 1;
+      *adj = NULL;
+      *w = NULL;
+      *i = *end = 0;
+      return;
+    }
+    s->tile = key;
+    ts->slot_of[key] = lru;
+    ts->misses++;
+  }
+  s->used = ++ts->tick;
+  *adj = s->adj;
+  *w = s->w;
+  *i = s->voff[u - t * ts->tile_size];
+  *end = s->voff[u - t * ts->tile_size + 1];
+}
+
+int tile_failed(GRAPH *g) {
+  int f;
+
+  if(g->adj_mode != ADJ_TILED)
+    return 0;
+  f = g->tiles->failed;
+  g->tiles->failed = 0;
+  return f;
+}
+
+void tile_close(TILE_STORE *ts) {
+  int k;
+
+  close(ts->fd);
+  for(k = 0; k < ts->nslots; k++) {
+    free(ts->slots[k].voff);
+    free(ts->slots[k].adj);
+    free(ts->slots[k].w);
+  }
+  free(ts->slots);
+  free(ts->slot_of);
+  free(ts->ix);
+  free(ts->in_degree);
+  free(ts->wbuf);
+  free(ts);
+}
+
+unsigned long tile_bytes(TILE_STORE *ts) {
+  unsigned long b = sizeof(TILE_STORE) + ts->nkeys * (sizeof(TILE_IX) + sizeof(int));
+  int k;
+
+  if(ts->in_degree != NULL)
+    b += ts->n * sizeof(int);
+  for(k = 0; k < ts->nslots; k++)
+    b += sizeof(TILE_SLOT) + (ts->tile_size + 1) * sizeof(long)
+      + ts->slots[k].cap * (sizeof(int) + sizeof(weight_t));
+  return b + ts->wbuf_cap * sizeof(double);
+}
+
+int g_write_tiles(GRAPH *g, const char *path, int tile_size) {
+  TILE_HDR h;
+  TILE_IX *ix;
+  EDGE_IT it;
+  weight_t w;
+  FILE *fp;
+  char *tmp;
+  uint64_t off;
+  int32_t x, *indeg = NULL;
+  int u, v, t, ok, nkeys;
+
+  if(tile_size <= 0)
+    tile_size = DEFAULT_TILE_SIZE;
+  adj_reverse(g);
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, TILE_MAGIC);
+  h.version = TILE_VERSION;
+  h.directed = g->directed;
+  h.n = g->n;
+  h.tile_size = tile_size;
+  h.ntiles = (g->n + tile_size - 1) / tile_size;
+  h.has_ext = g->int2ext != NULL;
+  for(u = 0; u < g->n; u++)
+    h.names_len += strlen(vname(g, u)) + 1;
+  nkeys = h.ntiles * (1 + g->directed);
+  if(g->directed) {
+    indeg = calloc(g->n > 0 ? g->n : 1, sizeof(int32_t));
+    for(u = 0; u < g->n; u++) {
+      edge_begin(g, u, &it);
+      while(edge_next(&it, &v, &w))
+	indeg[v]++;
+    }
+  }
+
+  // tiles go after the index, each padded like the arrays before it
+  ix = calloc(nkeys > 0 ? nkeys : 1, sizeof(TILE_IX));
+  off = sizeof(h) + pad8(h.names_len)
+    + (1 + h.has_ext + h.directed) * pad8(sizeof(int32_t) * g->n)
+    + sizeof(TILE_IX) * nkeys;
+  for(u = 0; u < g->n; u++) {
+    ix[u / tile_size].m += g->vertices[u].out_degree;
+    if(g->directed)
+      ix[h.ntiles + u / tile_size].m += indeg[u];
+  }
+  for(t = 0; t < nkeys; t++) {
+    ix[t].off = off;
+    off += pad8(sizeof(int32_t) * ix[t].m) + sizeof(double) * ix[t].m;
+  }
+
+  // write next to the target and rename, as rpt_save does
+  tmp = malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+  if((fp = fopen(tmp, "wb")) == NULL) {
+    fprintf(stderr, "error: cannot write %s\n", tmp);
+    free(tmp);
+    free(ix);
+    free(indeg);
+    return 0;
+  }
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  for(u = 0; u < g->n && ok; u++)
+    ok = fwrite(vname(g, u), strlen(vname(g, u)) + 1, 1, fp) == 1;
+  ok = ok && write_pad(fp, h.names_len);
+  for(u = 0; u < g->n && ok; u++) {
+    x = g->vertices[u].out_degree;
+    ok = fwrite(&x, sizeof(x), 1, fp) == 1;
+  }
+  ok = ok && write_pad(fp, sizeof(int32_t) * g->n);
+  for(u = 0; u < g->n && ok && h.has_ext; u++) {
+    x = g->int2ext[u];
+    ok = fwrite(&x, sizeof(x), 1, fp) == 1;
+  }
+  ok = ok && (!h.has_ext || write_pad(fp, sizeof(int32_t) * g->n));
+  if(g->directed)
+    ok = ok && fwrite(indeg, sizeof(int32_t), g->n, fp) == (size_t)g->n
+      && write_pad(fp, sizeof(int32_t) * g->n);
+  ok = ok && fwrite(ix, sizeof(TILE_IX), nkeys, fp) == (size_t)nkeys;
+  for(t = 0; t < nkeys && ok; t++)
+    ok = write_tile(g, fp, t % h.ntiles, tile_size, ix[t].m, t >= h.ntiles);
+  ok = ok && !tile_failed(g);   // g itself may be tiled
+  if(fclose(fp) != 0)
+    ok = 0;
+  if(ok && rename(tmp, path) != 0)
+    ok = 0;
+  if(!ok) {
+    fprintf(stderr, "error: cannot write %s\n", path);
+    remove(tmp);
+  }
+  free(tmp);
+  free(ix);
+  free(indeg);
+  return ok;
+}
+
+GRAPH * g_open_tiled(const char *path, int cache_tiles) {
+  TILE_HDR h;
+  TILE_STORE *ts;
+  GRAPH *g;
+  struct stat st;
+  char *names, *p, *seen;
+  int32_t *ibuf;
+  uint64_t off, m;
+  int fd, u, k, ok;
+
+  if((fd = open(path, O_RDONLY)) < 0) {
+    fprintf(stderr, "error: cannot open %s\n", path);
+    return NULL;
+  }
+  if(!read_at(fd, &h, sizeof(h), 0) || fstat(fd, &st) != 0
+     || memcmp(h.magic, TILE_MAGIC, sizeof(TILE_MAGIC)) != 0
+     || !(h.version == TILE_VERSION
+	  || (h.version == TILE_VERSION_UNDIRECTED && !h.directed))
+     || h.n <= 0 || h.tile_size <= 0
+     || h.ntiles != (h.n + h.tile_size - 1) / h.tile_size) {
+    fprintf(stderr, "error: %s is not a tiled graph\n", path);
+    close(fd);
+    return NULL;
+  }
+  if(cache_tiles <= 0)
+    cache_tiles = DEFAULT_CACHE_TILES;
+  if(cache_tiles > h.ntiles)
+    cache_tiles = h.ntiles;
+
+  ts = calloc(1, sizeof(TILE_STORE));
+  ts->fd = fd;
+  ts->n = h.n;
+  ts->tile_size = h.tile_size;
+  ts->ntiles = h.ntiles;
+  ts->nkeys = h.ntiles * (1 + (h.directed != 0));
+  ts->ix = malloc(sizeof(TILE_IX) * ts->nkeys);
+  ts->nslots = cache_tiles;
+  ts->slots = calloc(cache_tiles, sizeof(TILE_SLOT));
+  for(k = 0; k < cache_tiles; k++) {
+    ts->slots[k].tile = -1;
+    ts->slots[k].voff = malloc(sizeof(long) * (h.tile_size + 1));
+  }
+  ts->slot_of = malloc(sizeof(int) * ts->nkeys);
+  for(k = 0; k < ts->nkeys; k++)
+    ts->slot_of[k] = -1;
+
+  g = g_new(h.n, 0);
+  g->directed = h.directed != 0;
+  g->tiles = ts;
+  g->adj_mode = ADJ_TILED;
+  names = malloc(h.names_len + 1);
+  ibuf = malloc(sizeof(int32_t) * h.n);
+  off = sizeof(h);
+  ok = read_at(fd, names, h.names_len, off);
+  names[h.names_len] = '\0';
+  for(u = 0, p = names; u < h.n && ok; u++) {
+    if(p >= names + h.names_len)
+      ok = 0;
+    else if(*p != '\0')
+      g_intern_name(g, u, p);
+    p += strlen(p) + 1;
+  }
+  off += pad8(h.names_len);
+  ok = ok && read_at(fd, ibuf, sizeof(int32_t) * h.n, off);
+  for(u = 0; u < h.n && ok; u++)
+    ok = (g->vertices[u].out_degree = ibuf[u]) >= 0;
+  off += pad8(sizeof(int32_t) * h.n);
+  if(ok && h.has_ext) {
+    // must be a permutation: ext2int is its inverse
+    ok = read_at(fd, ibuf, sizeof(int32_t) * h.n, off);
+    seen = calloc(h.n, 1);
+    g->int2ext = malloc(sizeof(int) * h.n);
+    g->ext2int = malloc(sizeof(int) * h.n);
+    for(u = 0; u < h.n && ok; u++) {
+      ok = ibuf[u] >= 0 && ibuf[u] < h.n && !seen[ibuf[u]];
+      if(ok) {
+	seen[ibuf[u]] = 1;
+	g->int2ext[u] = ibuf[u];
+	g->ext2int[ibuf[u]] = u;
+      }
+    }
+    free(seen);
+    off += pad8(sizeof(int32_t) * h.n);
+  }
+  if(ok && h.directed) {
+    ts->in_degree = malloc(sizeof(int) * h.n);
+    ok = read_at(fd, ibuf, sizeof(int32_t) * h.n, off);
+    for(u = 0; u < h.n && ok; u++)
+      ok = (ts->in_degree[u] = ibuf[u]) >= 0;
+    off += pad8(sizeof(int32_t) * h.n);
+  }
+  ok = ok && read_at(fd, ts->ix, sizeof(TILE_IX) * ts->nkeys, off);
+  // each tile holds exactly the edges its degrees add up to, and
+  //   lies inside the file
+  for(k = 0; k < ts->nkeys && ok; k++) {
+    for(u = k % h.ntiles * h.tile_size, m = 0;
+	u < (k % h.ntiles + 1) * h.tile_size; u++)
+      m += key_degree(g, ts, k, u);
+    ok = m == ts->ix[k].m && ts->ix[k].off <= (uint64_t)st.st_size
+      && (uint64_t)st.st_size - ts->ix[k].off
+         >= pad8(sizeof(int32_t) * m) + sizeof(double) * m;
+  }
+  free(names);
+  free(ibuf);
+
+  if(!ok) {
+    fprintf(stderr, "error: %s is not a tiled graph\n", path);
+    g_free(g);
+    return NULL;
+  }
+  g_freeze_names(g);
+  return g;
+}
+
+void g_tile_stats(GRAPH *g, long *hits, long *misses) {
+  *hits = g->tiles != NULL ? g->tiles->hits : 0;
+  *misses = g->tiles != NULL ? g->tiles->misses : 0;
+}
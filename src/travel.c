@@ -24,55 +24,52 @@ static void trim_string(char *s) {
   }
 }
 
-void names_free(char **names, int n) {
-  int i;
-  for(i = 0; i < n; i++)
-    free(names[i]);
-  free(names);
-}
-
-void names_print(char **names, int n) {
+void names_print(const char **names, int n) {
   int i;
   for(i = 0; i < n; i++) {
     printf("%s ", names[i]);
   }
 }
 
-char * get_next_move(PATH_RPT *r, char *loc, double *dist) {
-  char **path;
-  int npath, i;
-  path = rpt_path(r, loc, dist, &npath);
-  char *ret = path[1];
-  free(path[0]);
-  for(i = 2; i < npath; i++) {
-    free(path[i]);
-  }
-  free(path);
-  return ret;
+const char * get_next_move(GRAPH *g, PATH_RPT *r, int loc, double *dist) {
+  *dist = rpt_dist(r, loc);
+  return g_vertex_name(g, rpt_next_hop(r, loc));
 }
 
-double start_travel(GRAPH *g, PATH_RPT *r, char *loc, char *dest) {
+double start_travel(GRAPH *g, PATH_RPT *r, const char *loc, const char *dest) {
   double dist, ret;
-  int j, recnum, nNeighbors, choice;
-  double *wNeighbors;
-  char *recmove;
+  int j, recnum, nNeighbors, choice, cap;
+  const char *recmove;
+  const char **locNeighbors = NULL;
+  double *wNeighbors = NULL;
   ret = 0;
+  cap = 0;
   while(strcmp(loc, dest) != 0) {
-    recmove = get_next_move(r, loc, &dist);
+    recmove = get_next_move(g, r, g_vertex_id(g, loc), &dist);
     printf("CURRENT LOCATION:\t%s\n", loc);
     printf("DESTINATION     :\t%s\n", dest);
-    printf("MINIMUM DISTANCE TO DESTINATION:\t%.2lf\n\n", dist);
+    if(recmove != NULL)
+      printf("MINIMUM DISTANCE TO DESTINATION:\t%.2lf\n\n", dist);
+    else  // one-way edges can lead away for good
+      printf("DESTINATION NO LONGER REACHABLE\n\n");
     printf("POSSIBLES MOVES:\n\n");
     
-    char **locNeighbors = g_get_neighbors(g, loc, &wNeighbors, &nNeighbors);
+    nNeighbors = g_get_neighbors_v(g, loc, locNeighbors, wNeighbors, cap);
+    if(nNeighbors > cap) {
+      cap = nNeighbors;
+      locNeighbors = realloc(locNeighbors, sizeof(char*)*cap);
+      wNeighbors = realloc(wNeighbors, sizeof(double)*cap);
+      g_get_neighbors_v(g, loc, locNeighbors, wNeighbors, cap);
+    }
     printf("\t0. I give up!\n");
     for(j = 0; j < nNeighbors; j++) {
-      if(strcmp(locNeighbors[j], recmove) == 0)
+      if(recmove != NULL && strcmp(locNeighbors[j], recmove) == 0)
 	recnum = j+1;
       printf("\t%d. %s (%.2lf units)\n", (j+1), locNeighbors[j], wNeighbors[j]);
     }
     
-    printf("RECOMMENDED MOVE:\t%d. %s\n\n", recnum, recmove);
+    if(recmove != NULL)
+      printf("RECOMMENDED MOVE:\t%d. %s\n\n", recnum, recmove);
     printf("SELECT A MOVE (ENTER A NUMBER):\t");
     while(scanf("%d", &choice) != 1 || choice < 0 || choice > nNeighbors) {
       printf("ERROR: INVALID CHOICE\n");
@@ -81,33 +78,42 @@ double start_travel(GRAPH *g, PATH_RPT *r, char *loc, char *dest) {
     } 
     choice--;
     if(choice < 0) {
-      free(loc);
-      free(recmove);
-      free(wNeighbors);
-      names_free(locNeighbors, nNeighbors);
-      return -1;
+      ret = -1;
+      break;
     }
-    free(loc);
-    loc = strdup(locNeighbors[choice]);
+    loc = locNeighbors[choice];
     ret += wNeighbors[choice];
     printf("\nTOTAL DISTANCE TRAVELED:\t%.2lf units\n", ret);
-    free(recmove);
-    free(wNeighbors);
-    names_free(locNeighbors, nNeighbors);
   }
-  free(loc);
+  free(locNeighbors);
+  free(wNeighbors);
   return ret;
 }
 
 int main(int argc, char *argv[]) {
-  if(argc != 2) {
-    printf("usage:  travel <graph_file>\n");
+  int merge = 0, chains = 0, a;
+
+  for(a = 1; a < argc && argv[a][0] == '-'; a++) {
+    if(strcmp(argv[a], "-m") == 0)
+      merge = 1;
+    else if(strcmp(argv[a], "-c") == 0)
+      chains = 1;
+    else
+      break;
+  }
+  if(a != argc - 1 || argv[a][0] == '-') {
+    printf("usage:  travel [-m] [-c] <graph_file>\n");
+    printf("  -m  merge duplicate roads, keeping the shortest\n");
+    printf("  -c  search around stretches of road without junctions\n");
     return 0;
   }
 
-  FILE *fp = fopen(argv[1], "r");
+  FILE *fp = fopen(argv[a], "r");
   GRAPH *g = g_from_stream(fp);
-  char **names = g_get_names(g);
+  long merged = merge ? g_collapse_multi_edges(g) : 0;
+  if(chains)
+    g_contract_chains(g);
+  const char **names = g_get_names_v(g);
   char *loc, *dest;
   int i;
 
@@ -115,6 +121,8 @@ int main(int argc, char *argv[]) {
   dest = malloc(sizeof(char)*(MAX_NAME_LEN+1));
   
   printf("Welcome to travel planner.\n\n");
+  if(merged > 0)
+    printf("(%ld duplicate roads merged)\n\n", merged);
   printf("Vertices:\n\n");
   printf("\t");
   names_print(names, g_size(g));
@@ -143,15 +151,19 @@ int main(int argc, char *argv[]) {
 
   PATH_RPT *dijk = g_shortest_path(g, dest);
   double dist;
-  int npath; 
-  char **path = rpt_path(dijk, loc, &dist, &npath);
+  int npath, locid; 
+  locid = g_vertex_id(g, loc);
+  dist = rpt_dist(dijk, locid);
+  npath = rpt_path_ids(dijk, locid, NULL, 0);
+  int *path = malloc(sizeof(int)*(npath > 0 ? npath : 1));
+  rpt_path_ids(dijk, locid, path, npath);
   if(dist < DBL_MAX) {
     printf("You can reach your destination in %.2lf units.\n\n", dist);
     printf("SHORTEST PATH:\n");
     for(i = 0; i < npath-1; i++) {
-      printf("\t%s ->\n", path[i]);
+      printf("\t%s ->\n", g_vertex_name(g, path[i]));
     }
-    printf("\t%s\n\n", path[i]);
+    printf("\t%s\n\n", g_vertex_name(g, path[i]));
     printf("TIME TO TRAVEL!\n");
     double totaldist = start_travel(g, dijk, loc, dest);
     
@@ -165,16 +177,11 @@ int main(int argc, char *argv[]) {
   }
   else {
     printf("Your destination is unreachable.\nGOODBYE.\n");
-    free(loc);
-  }
-  for(i = 0; i < npath; i++) {
-    if(path[i] != NULL)
-      free(path[i]);
   }
   free(path);
+  free(loc);
   free(dest);
   rpt_free(dijk);
-  names_free(names, g_size(g));
   g_free(g);
   fclose(fp);
 }